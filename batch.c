@@ -0,0 +1,174 @@
+/* Batch mode: runs a directory of independent scripts in parallel, each in
+ * a child forked from the process that evaluated the prelude. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "batch.h"
+#include "interpreter.h"
+#include "output.h"
+#include "talloc.h"
+
+// A script and the child running it, if any.
+typedef struct Script {
+    char *path;
+    pid_t pid;
+    int status;
+} Script;
+
+void batchError(char *message, char *path) {
+    outString("Batch error: ");
+    outString(message);
+    outString(": ");
+    outString(path);
+    outChar('\n');
+    outFlush();
+    texit(1);
+}
+
+int compareScripts(const void *first, const void *second) {
+    return strcmp(((const Script *)first)->path,
+                  ((const Script *)second)->path);
+}
+
+// Returns the .scm files in directory, sorted by name, and sets count.
+Script *findScripts(char *directory, int *count) {
+    DIR *dir = opendir(directory);
+    if (dir == NULL) {
+        batchError("could not open directory", directory);
+    }
+    int capacity = 64;
+    Script *scripts = talloc(capacity * sizeof(Script));
+    *count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t nameLength = strlen(entry->d_name);
+        if (nameLength < 5 ||
+            strcmp(entry->d_name + nameLength - 4, ".scm") != 0) {
+            continue;
+        }
+        if (*count == capacity) {
+            //talloc can't grow a block, so copy into a bigger one
+            Script *bigger = talloc(2 * capacity * sizeof(Script));
+            memcpy(bigger, scripts, capacity * sizeof(Script));
+            scripts = bigger;
+            capacity *= 2;
+        }
+        size_t directoryLength = strlen(directory);
+        char *path = talloc(directoryLength + nameLength + 2);
+        memcpy(path, directory, directoryLength);
+        path[directoryLength] = '/';
+        memcpy(path + directoryLength + 1, entry->d_name, nameLength + 1);
+        scripts[*count].path = path;
+        scripts[*count].pid = 0;
+        scripts[*count].status = 0;
+        (*count)++;
+    }
+    closedir(dir);
+    qsort(scripts, *count, sizeof(Script), compareScripts);
+    return scripts;
+}
+
+// The body of a child: evaluates the script with its output going to its
+// own file. An evaluation error exits the child with status 1.
+void runScript(char *path, Frame *globalFrame) {
+    size_t pathLength = strlen(path);
+    char *outputPath = talloc(pathLength + 5);
+    memcpy(outputPath, path, pathLength);
+    memcpy(outputPath + pathLength, ".out", 5);
+    int fd = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        batchError("could not create output file", outputPath);
+    }
+    setOutputFd(fd);
+    loadFile(path, globalFrame, 1);
+    outFlush();
+    texit(0);
+}
+
+pid_t startScript(char *path, Frame *globalFrame) {
+    outFlush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        runScript(path, globalFrame);
+    } else if (pid < 0) {
+        batchError("could not fork for", path);
+    }
+    return pid;
+}
+
+// Prints how a script's child ended.
+void reportScript(Script *script) {
+    outString(script->path);
+    if (WIFEXITED(script->status)) {
+        outString(" exit ");
+        outInt(WEXITSTATUS(script->status));
+    } else if (WIFSIGNALED(script->status)) {
+        outString(" signal ");
+        outInt(WTERMSIG(script->status));
+    }
+    outChar('\n');
+}
+
+double secondsSince(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int runBatch(char *directory, Frame *globalFrame, int workers) {
+    int count;
+    Script *scripts = findScripts(directory, &count);
+    if (workers < 1) {
+        workers = 1;
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int next = 0;
+    int running = 0;
+    int failed = 0;
+    while (next < count || running > 0) {
+        if (next < count && running < workers) {
+            scripts[next].pid = startScript(scripts[next].path, globalFrame);
+            next++;
+            running++;
+            continue;
+        }
+        int status;
+        pid_t finished = wait(&status);
+        if (finished < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < next; i++) {
+            if (scripts[i].pid == finished) {
+                scripts[i].status = status;
+                scripts[i].pid = 0;
+                running--;
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    failed++;
+                }
+            }
+        }
+    }
+    double elapsed = secondsSince(&start);
+    for (int i = 0; i < count; i++) {
+        reportScript(&scripts[i]);
+    }
+    outInt(count);
+    outString(" scripts, ");
+    outInt(failed);
+    outString(" failed, ");
+    outDouble(elapsed > 0 ? count / elapsed : 0);
+    outString(" scripts/s\n");
+    outFlush();
+    return failed;
+}
@@ -0,0 +1,14 @@
+#include "value.h"
+
+#ifndef _BATCH
+#define _BATCH
+
+// Runs every .scm file in directory as an independent script, each in its
+// own child forked from this process so that all of them start from the
+// already evaluated global frame. Up to workers scripts run at once. What a
+// script prints goes to a file next to it with ".out" appended to its name.
+// Prints each script's exit status, then how many scripts ran per second.
+// Returns the number of scripts that failed.
+int runBatch(char *directory, Frame *globalFrame, int workers);
+
+#endif
@@ -0,0 +1,140 @@
+/* Front-end scaling benchmark. For each size given, generates a synthetic
+ * source and times tokenize(), parse() and evaluation of the result
+ * separately, printing a tab-separated row per size. The last line gives
+ * each stage's growth exponent between the smallest and largest sizes:
+ * about 1 for work linear in the input, about 2 for quadratic work such as
+ * rescanning a stack or list on every token.
+ *
+ * Usage: frontbench [-d depth] [-m mix] [-l length] [-w width] MB [MB ...] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "generator.h"
+#include "../interpreter.h"
+#include "../tokenizer.h"
+#include "../parser.h"
+#include "../linkedlist.h"
+
+// Growth exponent above which a stage is reported as worse than linear.
+// Cache effects alone push it a little above 1.
+#define SUPERLINEAR_EXPONENT 1.5
+
+typedef struct Timing {
+    size_t bytes;
+    long tokens;
+    double tokenize;
+    double parse;
+    double eval;
+} Timing;
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+Timing measure(GeneratorOptions *options) {
+    Timing timing;
+    char *source;
+    size_t size;
+    FILE *out = open_memstream(&source, &size);
+    writeSource(out, options);
+    fclose(out);
+    timing.bytes = size;
+
+    Interpreter *interp = newInterpreter();
+    setInputBuffer(source, size);
+    double start = now();
+    Value *tokens = tokenize();
+    timing.tokenize = now() - start;
+    timing.tokens = length(tokens);
+
+    start = now();
+    Value *tree = parse(tokens);
+    timing.parse = now() - start;
+
+    start = now();
+    while (tree->type != NULL_TYPE) {
+        eval(car(tree), interp->globalFrame);
+        tree = cdr(tree);
+    }
+    timing.eval = now() - start;
+
+    freeInterpreter(interp);
+    free(source);
+    return timing;
+}
+
+// Prints the exponent k for which a stage's time grows like tokens^k.
+void reportScaling(char *stage, double firstTime, double lastTime,
+                   Timing *first, Timing *last) {
+    double exponent = log(lastTime / firstTime) /
+                      log((double)last->tokens / first->tokens);
+    printf("\t%s %.2f%s", stage, exponent,
+           exponent > SUPERLINEAR_EXPONENT ? " (superlinear)" : "");
+}
+
+int main(int argc, char **argv) {
+    GeneratorOptions options;
+    defaultGeneratorOptions(&options, 0);
+    int option;
+    while ((option = getopt(argc, argv, "d:m:l:w:")) != -1) {
+        switch (option) {
+            case 'd':
+                options.depth = atoi(optarg);
+                break;
+            case 'm':
+                if (!parseTokenMix(optarg, &options)) {
+                    fprintf(stderr, "bad token mix %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'l':
+                options.stringLength = atoi(optarg);
+                break;
+            case 'w':
+                options.width = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-d depth] [-m mix] [-l length] "
+                                "[-w width] MB [MB ...]\n", argv[0]);
+                return 1;
+        }
+    }
+    int count = argc - optind;
+    if (count < 1) {
+        fprintf(stderr, "no sizes given\n");
+        return 1;
+    }
+    Timing *timings = calloc(count, sizeof(Timing));
+    printf("bytes\ttokens\ttokenize_s\ttokenize_mb_s\ttokenize_tok_s"
+           "\tparse_s\tparse_mb_s\tparse_tok_s\teval_s\teval_mb_s\n");
+    for (int i = 0; i < count; i++) {
+        options.size = (size_t)(atof(argv[optind + i]) * (1 << 20));
+        Timing timing = measure(&options);
+        timings[i] = timing;
+        double megabytes = timing.bytes / 1e6;
+        printf("%zu\t%ld\t%.4f\t%.1f\t%.0f\t%.4f\t%.1f\t%.0f\t%.4f\t%.1f\n",
+               timing.bytes, timing.tokens, timing.tokenize,
+               megabytes / timing.tokenize, timing.tokens / timing.tokenize,
+               timing.parse, megabytes / timing.parse,
+               timing.tokens / timing.parse, timing.eval,
+               megabytes / timing.eval);
+        fflush(stdout);
+    }
+    Timing *first = &timings[0];
+    Timing *last = &timings[count - 1];
+    if (count > 1 && last->tokens > first->tokens) {
+        printf("# growth exponent:");
+        reportScaling("tokenize", first->tokenize, last->tokenize, first,
+                      last);
+        reportScaling("parse", first->parse, last->parse, first, last);
+        reportScaling("eval", first->eval, last->eval, first, last);
+        printf("\n");
+    }
+    free(timings);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/* Synthetic Scheme sources for the front-end benchmarks. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "generator.h"
+
+void defaultGeneratorOptions(GeneratorOptions *options, size_t size) {
+    options->size = size;
+    options->depth = 4;
+    options->symbolWeight = 1;
+    options->integerWeight = 1;
+    options->doubleWeight = 1;
+    options->stringWeight = 1;
+    options->stringLength = 16;
+    options->width = 6;
+    options->seed = 1;
+}
+
+int parseTokenMix(const char *mix, GeneratorOptions *options) {
+    return sscanf(mix, "%d,%d,%d,%d", &options->symbolWeight,
+                  &options->integerWeight, &options->doubleWeight,
+                  &options->stringWeight) == 4 &&
+           options->symbolWeight + options->integerWeight +
+           options->doubleWeight + options->stringWeight > 0;
+}
+
+// A small linear congruential generator, so sources are the same on every
+// platform for a given seed.
+unsigned nextRandom(unsigned *state) {
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 16) & 0x7fff;
+}
+
+size_t writeAtom(FILE *out, GeneratorOptions *options, unsigned *state) {
+    int total = options->symbolWeight + options->integerWeight +
+                options->doubleWeight + options->stringWeight;
+    int pick = nextRandom(state) % total;
+    unsigned number = nextRandom(state);
+    if (pick < options->symbolWeight) {
+        return fprintf(out, "sym-%u", number);
+    }
+    pick -= options->symbolWeight;
+    if (pick < options->integerWeight) {
+        return fprintf(out, "%u", number);
+    }
+    pick -= options->integerWeight;
+    if (pick < options->doubleWeight) {
+        return fprintf(out, "%u.%u", number, nextRandom(state) % 1000);
+    }
+    fputc('"', out);
+    for (int i = 0; i < options->stringLength; i++) {
+        fputc('a' + (i + number) % 26, out);
+    }
+    fputc('"', out);
+    return options->stringLength + 2;
+}
+
+size_t writeList(FILE *out, GeneratorOptions *options, int depth,
+                 unsigned *state) {
+    size_t written = 1;
+    fputc('(', out);
+    for (int i = 0; i < options->width; i++) {
+        if (i > 0) {
+            fputc(' ', out);
+            written++;
+        }
+        //one item per list goes a level deeper
+        if (depth > 1 && i == options->width / 2) {
+            written += writeList(out, options, depth - 1, state);
+        } else {
+            written += writeAtom(out, options, state);
+        }
+    }
+    fputc(')', out);
+    return written + 1;
+}
+
+size_t writeSource(FILE *out, GeneratorOptions *options) {
+    unsigned state = options->seed;
+    size_t written = 0;
+    long form = 0;
+    while (written < options->size) {
+        written += fprintf(out, "(define g%ld '", form);
+        written += writeList(out, options, options->depth, &state);
+        written += fprintf(out, ")\n");
+        form++;
+    }
+    return written;
+}
@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include <stddef.h>
+
+#ifndef _GENERATOR
+#define _GENERATOR
+
+// What a generated Scheme source looks like. Every top-level form is a
+// define of quoted data, so any mix of tokens still evaluates.
+typedef struct GeneratorOptions {
+    // Total size to generate, in bytes; the last form may run a little past.
+    size_t size;
+    // How deeply lists nest inside each form.
+    int depth;
+    // Relative weights of symbols, integers, doubles and strings among the
+    // atoms.
+    int symbolWeight;
+    int integerWeight;
+    int doubleWeight;
+    int stringWeight;
+    // Length of the text inside each string literal.
+    int stringLength;
+    // Items per list.
+    int width;
+    unsigned seed;
+} GeneratorOptions;
+
+// Fills options with the defaults: depth 4, an even mix of atoms, strings
+// of 16 characters and lists of 6 items.
+void defaultGeneratorOptions(GeneratorOptions *options, size_t size);
+
+// Parses a mix given as "symbols,integers,doubles,strings" into options.
+// Returns 0 if it isn't four comma-separated weights.
+int parseTokenMix(const char *mix, GeneratorOptions *options);
+
+// Writes a source matching options to out. Returns the bytes written.
+size_t writeSource(FILE *out, GeneratorOptions *options);
+
+#endif
@@ -0,0 +1,50 @@
+/* Writes a synthetic Scheme source to stdout.
+ *
+ * Usage: gensource [-s MB] [-d depth] [-m symbols,integers,doubles,strings]
+ *                  [-l string length] [-w list width] [-r seed] */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "generator.h"
+
+int main(int argc, char **argv) {
+    GeneratorOptions options;
+    defaultGeneratorOptions(&options, 1 << 20);
+    int option;
+    while ((option = getopt(argc, argv, "s:d:m:l:w:r:")) != -1) {
+        switch (option) {
+            case 's':
+                options.size = (size_t)(atof(optarg) * (1 << 20));
+                break;
+            case 'd':
+                options.depth = atoi(optarg);
+                break;
+            case 'm':
+                if (!parseTokenMix(optarg, &options)) {
+                    fprintf(stderr, "bad token mix %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'l':
+                options.stringLength = atoi(optarg);
+                break;
+            case 'w':
+                options.width = atoi(optarg);
+                break;
+            case 'r':
+                options.seed = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s MB] [-d depth] [-m mix] "
+                                "[-l length] [-w width] [-r seed]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (options.depth < 1 || options.width < 1) {
+        fprintf(stderr, "depth and width must be at least 1\n");
+        return 1;
+    }
+    writeSource(stdout, &options);
+    return 0;
+}
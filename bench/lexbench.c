@@ -0,0 +1,91 @@
+/* Tokenizer throughput benchmark. Generates a synthetic Scheme source of the
+ * requested size in memory (or reads the file given with -f), tokenizes it
+ * with nextToken() and reports MB/s and tokens/s. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../tokenizer.h"
+#include "../talloc.h"
+
+// Allocations are released every so many tokens, so the allocator's blocks
+// stay in cache and the timing reflects scanning rather than page faults.
+#define TOKENS_PER_FREE (1 << 12)
+
+char *generateSource(size_t size) {
+    char *source = malloc(size + 256);
+    size_t length = 0;
+    long i = 0;
+    while (length < size) {
+        length += sprintf(source + length,
+            "(define (item-%ld x)\n"
+            "  ; compute something from x\n"
+            "  (if (< x %ld) (+ x %ld.25) \"string value %ld\"))\n"
+            "'(alpha beta-gamma %ld #t #f -%ld)\n",
+            i, i, i, i, i, i);
+        i++;
+    }
+    return source;
+}
+
+char *readSource(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *source = malloc(*size);
+    if (fread(source, 1, *size, file) != *size) {
+        perror(path);
+        exit(1);
+    }
+    fclose(file);
+    return source;
+}
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    size_t size = 64 << 20;
+    int repetitions = 5;
+    char *source;
+    if (argc > 2 && !strcmp(argv[1], "-f")) {
+        source = readSource(argv[2], &size);
+    } else {
+        if (argc > 1) {
+            size = (size_t)atol(argv[1]) << 20;
+        }
+        source = generateSource(size);
+        size = strlen(source);
+    }
+    double best = 0;
+    long tokens = 0;
+    for (int rep = 0; rep < repetitions; rep++) {
+        setInputBuffer(source, size);
+        tokens = 0;
+        double start = now();
+        while (nextToken() != NULL) {
+            tokens++;
+            if (tokens % TOKENS_PER_FREE == 0) {
+                tfree();
+            }
+        }
+        double elapsed = now() - start;
+        tfree();
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    printf("bytes\ttokens\tseconds\tMB/s\ttokens/s\n");
+    printf("%zu\t%ld\t%.4f\t%.1f\t%.0f\n", size, tokens, best,
+           size / best / 1e6, tokens / best);
+    free(source);
+    return 0;
+}
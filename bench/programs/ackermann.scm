@@ -0,0 +1,8 @@
+; Ackermann's function: very deep recursion with little work per call.
+(define ack
+  (lambda (m n)
+    (cond ((= m 0) (+ n 1))
+          ((= n 0) (ack (- m 1) 1))
+          (else (ack (- m 1) (ack m (- n 1)))))))
+(ack 2 9)
+(ack 3 5)
@@ -0,0 +1,12 @@
+; Non-tail recursion thousands of frames deep, repeated.
+(define count-down
+  (lambda (n)
+    (if (= n 0)
+        0
+        (+ 1 (count-down (- n 1))))))
+(define repeat
+  (lambda (times total)
+    (if (= times 0)
+        total
+        (repeat (- times 1) (+ total (count-down 5000))))))
+(repeat 20 0)
@@ -0,0 +1,13 @@
+; Non-tail recursion far deeper than the C stack, building and summing a
+; long list.
+(define build
+  (lambda (n)
+    (if (= n 0)
+        (quote ())
+        (cons n (build (- n 1))))))
+(define sum
+  (lambda (items)
+    (if (null? items)
+        0
+        (+ (car items) (sum (cdr items))))))
+(sum (build 200000))
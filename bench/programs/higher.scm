@@ -0,0 +1,16 @@
+; Higher-order list primitives over a long list: map, filter, the folds and
+; apply, with both closures and primitives as the procedure.
+(define numbers
+  (let loop ((i 0) (acc '()))
+    (if (= i 20000) acc (loop (+ i 1) (cons (modulo i 97) acc)))))
+(define round
+  (lambda (n total)
+    (if (= n 0)
+        total
+        (round (- n 1)
+               (+ total
+                  (fold-left + 0 (map (lambda (x) (* x 2)) numbers))
+                  (length (filter (lambda (x) (< x 50)) numbers))
+                  (fold-right (lambda (x acc) (modulo (+ x acc) 1000)) 0 numbers)
+                  (apply + (map - numbers numbers)))))))
+(round 5 0)
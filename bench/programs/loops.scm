@@ -0,0 +1,8 @@
+; Named let and do loops: iteration without recursion through apply.
+(let loop ((i 0) (acc 0))
+  (if (= i 100000)
+      acc
+      (loop (+ i 1) (modulo (+ acc i) 1000))))
+(do ((i 0 (+ i 1))
+     (acc 0 (modulo (+ acc (* i 3)) 1000)))
+    ((= i 100000) acc))
@@ -0,0 +1,18 @@
+; Loops written with syntax-rules macros. Each use is expanded once, before
+; the loop runs, so the iterations cost what the hand-written forms would.
+(define-syntax while
+  (syntax-rules ()
+    ((_ test body ...) (let loop () (if test (begin body ... (loop)) #t)))))
+(define-syntax inc!
+  (syntax-rules ()
+    ((_ variable) (set! variable (+ variable 1)))
+    ((_ variable step) (set! variable (+ variable step)))))
+(define-syntax unless-zero
+  (syntax-rules ()
+    ((_ value body) (if (= value 0) 0 body))))
+(define total 0)
+(define i 0)
+(while (< i 100000)
+  (inc! total (unless-zero (modulo i 7) (modulo i 11)))
+  (inc! i))
+total
@@ -0,0 +1,38 @@
+; Counts the solutions to the n-queens problem: list building and closures.
+(define ok?
+  (lambda (row dist placed)
+    (if (null? placed)
+        #t
+        (and (not-equal (car placed) (+ row dist))
+             (not-equal (car placed) (- row dist))
+             (not-equal (car placed) row)
+             (ok? row (+ dist 1) (cdr placed))))))
+(define not-equal
+  (lambda (a b)
+    (if (= a b) #f #t)))
+(define try
+  (lambda (candidates rejected placed)
+    (if (null? candidates)
+        (if (null? rejected) 1 0)
+        (+ (if (ok? (car candidates) 1 placed)
+               (try (append-lists (cdr candidates) rejected)
+                    '()
+                    (cons (car candidates) placed))
+               0)
+           (try (cdr candidates)
+                (cons (car candidates) rejected)
+                placed)))))
+(define append-lists
+  (lambda (a b)
+    (if (null? a)
+        b
+        (cons (car a) (append-lists (cdr a) b)))))
+(define range
+  (lambda (from to)
+    (if (> from to)
+        '()
+        (cons from (range (+ from 1) to)))))
+(define queens
+  (lambda (n)
+    (try (range 1 n) '() '())))
+(queens 7)
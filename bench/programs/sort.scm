@@ -0,0 +1,33 @@
+; Merge sort of a pseudo-random list: allocation-heavy list processing.
+(define make-list
+  (lambda (n seed)
+    (if (= n 0)
+        '()
+        (cons seed (make-list (- n 1) (modulo (+ (* seed 1103) 12345) 65536))))))
+(define split
+  (lambda (items)
+    (if (or (null? items) (null? (cdr items)))
+        (cons items '())
+        (let ((rest (split (cdr (cdr items)))))
+          (cons (cons (car items) (car rest))
+                (cons (car (cdr items)) (cdr rest)))))))
+(define merge
+  (lambda (a b)
+    (cond ((null? a) b)
+          ((null? b) a)
+          ((< (car b) (car a)) (cons (car b) (merge a (cdr b))))
+          (else (cons (car a) (merge (cdr a) b))))))
+(define sort
+  (lambda (items)
+    (if (or (null? items) (null? (cdr items)))
+        items
+        (let ((halves (split items)))
+          (merge (sort (car halves)) (sort (cdr halves)))))))
+(define first-n
+  (lambda (items n)
+    (if (= n 0)
+        '()
+        (cons (car items) (first-n (cdr items) (- n 1))))))
+(define data (make-list 2000 1))
+(first-n (sort data) 10)
+(first-n (sort (sort data)) 10)
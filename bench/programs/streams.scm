@@ -0,0 +1,22 @@
+; Lazy streams: a prime filter over the integers and a long
+; delay-force chain, both forced one element at a time.
+(define integers-from
+  (lambda (n) (cons-stream n (integers-from (+ n 1)))))
+(define stream-filter
+  (lambda (keep? s)
+    (if (keep? (stream-car s))
+        (cons-stream (stream-car s) (stream-filter keep? (stream-cdr s)))
+        (stream-filter keep? (stream-cdr s)))))
+(define stream-ref
+  (lambda (s n)
+    (if (= n 0) (stream-car s) (stream-ref (stream-cdr s) (- n 1)))))
+(define prime?
+  (lambda (n)
+    (let loop ((d 2))
+      (cond ((> (* d d) n) #t)
+            ((= (modulo n d) 0) #f)
+            (else (loop (+ d 1)))))))
+(stream-ref (stream-filter prime? (integers-from 2)) 800)
+(define countdown
+  (lambda (n) (delay-force (if (= n 0) (delay n) (countdown (- n 1))))))
+(force (countdown 200000))
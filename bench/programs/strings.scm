@@ -0,0 +1,17 @@
+; Builds long lists of strings and symbols and writes them out. There are no
+; string primitives, so this measures string values and the output path.
+(define build
+  (lambda (n acc)
+    (if (= n 0)
+        acc
+        (build (- n 1) (cons "a string value" (cons 'symbol (cons n acc)))))))
+(define emit
+  (lambda (items)
+    (if (null? items)
+        0
+        (begin (write (car items))
+               (display " ")
+               (emit (cdr items))))))
+(emit (build 3000 '()))
+(newline)
+(build 3000 '())
@@ -0,0 +1,220 @@
+/* Runs the benchmark programs in bench/programs, plus a generated file of
+ * many top-level defines, through the interpreter several times each and
+ * prints a tab-separated table: wall time, peak RSS and the interpreter's
+ * talloc counts for every program.
+ *
+ * Usage: run interpreter [repetitions [program.scm ...]]
+ * With no programs given, every .scm file in bench/programs is run. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define PROGRAM_DIR "bench/programs"
+#define DEFINE_COUNT 4000
+
+// The measurements of one run of a program.
+typedef struct Run {
+    double seconds;
+    long maxRss;
+    size_t calls;
+    size_t bytes;
+    size_t blocks;
+    int status;
+} Run;
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+// Writes a file of count global definitions, each using the one before, and
+// a final expression that walks the chain, to path.
+void generateDefines(const char *path, int count) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(file, "(define value-0 0)\n");
+    fprintf(file, "(define step-0 (lambda (x) x))\n");
+    for (int i = 1; i < count; i++) {
+        fprintf(file, "(define value-%d (+ value-%d %d))\n", i, i - 1, i);
+        fprintf(file, "(define step-%d (lambda (x) (step-%d (+ x 1))))\n",
+                i, i - 1);
+    }
+    fprintf(file, "(step-%d value-%d)\n", count - 1, count - 1);
+    fclose(file);
+}
+
+// Reads the counts the interpreter wrote to statsPath on exit.
+void readStats(const char *statsPath, Run *run) {
+    FILE *file = fopen(statsPath, "r");
+    if (file == NULL) {
+        return;
+    }
+    if (fscanf(file, "calls=%zu bytes=%zu blocks=%zu", &run->calls,
+               &run->bytes, &run->blocks) != 3) {
+        run->calls = run->bytes = run->blocks = 0;
+    }
+    fclose(file);
+}
+
+// Runs the interpreter on program once, with its output discarded.
+Run runOnce(const char *interpreter, const char *program,
+            const char *statsPath) {
+    Run run;
+    memset(&run, 0, sizeof(run));
+    unlink(statsPath);
+    double start = now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, 1);
+        setenv("SCHEME_TALLOC_STATS", statsPath, 1);
+        //parse every time rather than measuring the form cache
+        setenv("SCHEME_CACHE_DIR", "", 1);
+        execl(interpreter, interpreter, program, (char *)NULL);
+        perror(interpreter);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    run.seconds = now() - start;
+    run.maxRss = usage.ru_maxrss;
+    run.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128;
+    readStats(statsPath, &run);
+    return run;
+}
+
+int compareDoubles(const void *first, const void *second) {
+    double a = *(const double *)first;
+    double b = *(const double *)second;
+    return (a > b) - (a < b);
+}
+
+// Runs program repetitions times and prints its row of the table. Returns
+// the exit status of a failing run, or 0 if they all succeeded.
+int benchmark(const char *interpreter, const char *name, const char *program,
+                int repetitions, const char *statsPath) {
+    double *times = malloc(repetitions * sizeof(double));
+    double total = 0;
+    long maxRss = 0;
+    Run last;
+    int status = 0;
+    for (int i = 0; i < repetitions; i++) {
+        last = runOnce(interpreter, program, statsPath);
+        times[i] = last.seconds;
+        total += last.seconds;
+        if (last.maxRss > maxRss) {
+            maxRss = last.maxRss;
+        }
+        if (last.status != 0) {
+            status = last.status;
+        }
+    }
+    qsort(times, repetitions, sizeof(double), compareDoubles);
+    printf("%s\t%d\t%.3f\t%.3f\t%.3f\t%ld\t%zu\t%zu\t%zu\t%d\n", name,
+           repetitions, times[0] * 1000, times[repetitions / 2] * 1000,
+           total / repetitions * 1000, maxRss, last.calls, last.bytes,
+           last.blocks, status);
+    fflush(stdout);
+    free(times);
+    return status;
+}
+
+int compareNames(const void *first, const void *second) {
+    return strcmp(*(char *const *)first, *(char *const *)second);
+}
+
+// Returns the sorted paths of the .scm files in PROGRAM_DIR.
+char **findPrograms(int *count) {
+    DIR *dir = opendir(PROGRAM_DIR);
+    if (dir == NULL) {
+        perror(PROGRAM_DIR);
+        exit(1);
+    }
+    char **programs = NULL;
+    *count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length < 5 || strcmp(entry->d_name + length - 4, ".scm") != 0) {
+            continue;
+        }
+        programs = realloc(programs, (*count + 1) * sizeof(char *));
+        programs[*count] = malloc(sizeof(PROGRAM_DIR) + length + 1);
+        sprintf(programs[*count], "%s/%s", PROGRAM_DIR, entry->d_name);
+        (*count)++;
+    }
+    closedir(dir);
+    qsort(programs, *count, sizeof(char *), compareNames);
+    return programs;
+}
+
+// The name a program is reported under: its file name without ".scm".
+char *programName(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *start = slash != NULL ? slash + 1 : path;
+    size_t length = strlen(start);
+    if (length > 4 && !strcmp(start + length - 4, ".scm")) {
+        length -= 4;
+    }
+    char *name = malloc(length + 1);
+    memcpy(name, start, length);
+    name[length] = '\0';
+    return name;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s interpreter [repetitions [program ...]]\n",
+                argv[0]);
+        return 1;
+    }
+    const char *interpreter = argv[1];
+    int repetitions = argc > 2 ? atoi(argv[2]) : 5;
+    if (repetitions < 1) {
+        repetitions = 1;
+    }
+    char **programs;
+    int count;
+    if (argc > 3) {
+        programs = argv + 3;
+        count = argc - 3;
+    } else {
+        programs = findPrograms(&count);
+    }
+
+    char statsPath[] = "/tmp/scheme-bench-stats-XXXXXX";
+    char definesPath[] = "/tmp/scheme-bench-defines-XXXXXX.scm";
+    close(mkstemp(statsPath));
+    close(mkstemps(definesPath, 4));
+    generateDefines(definesPath, DEFINE_COUNT);
+
+    printf("program\treps\tmin_ms\tmedian_ms\tmean_ms\tmax_rss_kb"
+           "\ttalloc_calls\ttalloc_bytes\ttalloc_blocks\tstatus\n");
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (benchmark(interpreter, programName(programs[i]), programs[i],
+                      repetitions, statsPath) != 0) {
+            failed = 1;
+        }
+    }
+    if (argc <= 3) {
+        if (benchmark(interpreter, "defines", definesPath, repetitions,
+                      statsPath) != 0) {
+            failed = 1;
+        }
+    }
+    unlink(statsPath);
+    unlink(definesPath);
+    return failed;
+}
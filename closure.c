@@ -0,0 +1,332 @@
+/* Free-variable analysis of lambda expressions, and the compact frames
+ * closures keep. */
+#include <stdint.h>
+#include <string.h>
+#include "closure.h"
+#include "interpreter.h"
+#include "linkedlist.h"
+#include "metrics.h"
+#include "symbol.h"
+#include "talloc.h"
+
+void initFormTable(FormTable *table) {
+    memset(table, 0, sizeof(FormTable));
+    pthread_mutex_init(&table->lock, NULL);
+}
+
+void freeFormTable(FormTable *table) {
+    free(table->keys);
+    free(table->values);
+    pthread_mutex_destroy(&table->lock);
+}
+
+size_t hashForm(Value *form, size_t capacity) {
+    uint64_t key = (uint64_t)(uintptr_t)form;
+    key = (key ^ (key >> 33)) * 0xff51afd7ed558ccdull;
+    return (key ^ (key >> 33)) & (capacity - 1);
+}
+
+// Returns where form's entry is or would go in the table.
+size_t findForm(FormTable *table, Value *form) {
+    size_t slot = hashForm(form, table->capacity);
+    while (table->keys[slot] != NULL && table->keys[slot] != form) {
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    return slot;
+}
+
+void growFormTable(FormTable *table) {
+    Value **oldKeys = table->keys;
+    Value **oldValues = table->values;
+    size_t oldCapacity = table->capacity;
+    table->capacity = oldCapacity ? oldCapacity * 2 : 256;
+    table->keys = calloc(table->capacity, sizeof(Value *));
+    table->values = malloc(table->capacity * sizeof(Value *));
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldKeys[i] != NULL) {
+            size_t slot = findForm(table, oldKeys[i]);
+            table->keys[slot] = oldKeys[i];
+            table->values[slot] = oldValues[i];
+        }
+    }
+    free(oldKeys);
+    free(oldValues);
+}
+
+/* Analysis */
+
+int inNameList(char *name, Value *list) {
+    for (; list->type == CONS_TYPE; list = cdr(list)) {
+        if (sameName(car(list)->s, name)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Special forms that take only expressions after their keyword.
+int isExpressionForm(char *name) {
+    return !strcmp(name, "if") || !strcmp(name, "begin") ||
+           !strcmp(name, "and") || !strcmp(name, "or") ||
+           !strcmp(name, "set!") || !strcmp(name, "delay") ||
+           !strcmp(name, "delay-force") || !strcmp(name, "cons-stream");
+}
+
+void findFree(Value *expr, Value *bound, Value **free);
+void findFreeEach(Value *exprs, Value *bound, Value **free);
+
+// Finds the free variables of (lambda . lambdaArgs).
+void findFreeLambda(Value *lambdaArgs, Value *bound, Value **free) {
+    Value *params = car(lambdaArgs);
+    for (; params->type == CONS_TYPE; params = cdr(params)) {
+        bound = cons(car(params), bound);
+    }
+    if (params->type == SYMBOL_TYPE) {
+        bound = cons(params, bound);
+    }
+    findFreeEach(cdr(lambdaArgs), bound, free);
+}
+
+void findFreeEach(Value *exprs, Value *bound, Value **free) {
+    for (; exprs->type == CONS_TYPE; exprs = cdr(exprs)) {
+        findFree(car(exprs), bound, free);
+    }
+}
+
+// How the initial values of a binding list see its names.
+enum { PARALLEL_SCOPE, SEQUENTIAL_SCOPE, RECURSIVE_SCOPE };
+
+// Adds the names of a let-style binding list to bound and finds the free
+// variables of their initial values: outside the new names for let, after
+// the ones before them for let*, and inside all of them for letrec.
+Value *findFreeBindings(Value *bindings, Value *bound, int scope,
+                        Value **free) {
+    Value *outer = bound;
+    Value *inits = bindings;
+    for (; bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+        Value *binding = car(bindings);
+        if (binding->type != CONS_TYPE) {
+            continue;
+        }
+        if (scope == SEQUENTIAL_SCOPE) {
+            findFreeEach(cdr(binding), bound, free);
+        }
+        if (car(binding)->type == SYMBOL_TYPE) {
+            bound = cons(car(binding), bound);
+        }
+    }
+    for (; scope != SEQUENTIAL_SCOPE && inits->type == CONS_TYPE;
+         inits = cdr(inits)) {
+        if (car(inits)->type == CONS_TYPE) {
+            findFreeEach(cdr(car(inits)),
+                         scope == RECURSIVE_SCOPE ? bound : outer, free);
+        }
+    }
+    return bound;
+}
+
+/*
+* Adds to *free each name expr refers to that isn't in bound. Names bound
+* inside expr that it still lists can only make a closure keep more than
+* it needs, never less, so the special forms are followed only as far as
+* keeps that list short.
+*/
+void findFree(Value *expr, Value *bound, Value **free) {
+    if (expr->type == SYMBOL_TYPE) {
+        if (!inNameList(expr->s, bound) && !inNameList(expr->s, *free)) {
+            *free = cons(expr, *free);
+        }
+        return;
+    } else if (expr->type != CONS_TYPE) {
+        return;
+    }
+    Value *head = car(expr);
+    Value *args = cdr(expr);
+    if (head->type != SYMBOL_TYPE || args->type != CONS_TYPE) {
+        findFreeEach(expr, bound, free);
+        return;
+    }
+    char *name = head->s;
+    if (!strcmp(name, "quote") || !strcmp(name, "define-syntax")) {
+        return;
+    } else if (!strcmp(name, "lambda")) {
+        findFreeLambda(args, bound, free);
+    } else if (!strcmp(name, "let") && car(args)->type == SYMBOL_TYPE &&
+               cdr(args)->type == CONS_TYPE) {
+        //the loop's name isn't bound for the initial values
+        Value *inner = findFreeBindings(car(cdr(args)), bound,
+                                        PARALLEL_SCOPE, free);
+        findFreeEach(cdr(cdr(args)), cons(car(args), inner), free);
+    } else if (!strcmp(name, "let") || !strcmp(name, "let*") ||
+               !strcmp(name, "letrec")) {
+        int scope = !strcmp(name, "let") ? PARALLEL_SCOPE
+                    : !strcmp(name, "let*") ? SEQUENTIAL_SCOPE
+                    : RECURSIVE_SCOPE;
+        Value *inner = findFreeBindings(car(args), bound, scope, free);
+        findFreeEach(cdr(args), inner, free);
+    } else if (!strcmp(name, "do")) {
+        Value *inner = findFreeBindings(car(args), bound, PARALLEL_SCOPE,
+                                        free);
+        //the steps are evaluated with the variables bound
+        for (Value *specs = car(args); specs->type == CONS_TYPE;
+             specs = cdr(specs)) {
+            if (car(specs)->type == CONS_TYPE &&
+                cdr(car(specs))->type == CONS_TYPE) {
+                findFreeEach(cdr(cdr(car(specs))), inner, free);
+            }
+        }
+        findFreeEach(cdr(args), inner, free);
+    } else if (!strcmp(name, "define")) {
+        findFreeEach(cdr(args), cons(car(args), bound), free);
+    } else if (!strcmp(name, "cond")) {
+        for (; args->type == CONS_TYPE; args = cdr(args)) {
+            Value *clause = car(args);
+            if (clause->type == CONS_TYPE && car(clause)->type == SYMBOL_TYPE &&
+                !strcmp(car(clause)->s, "else")) {
+                clause = cdr(clause);
+            }
+            findFreeEach(clause, bound, free);
+        }
+    } else if (isExpressionForm(name)) {
+        findFreeEach(args, bound, free);
+    } else {
+        findFreeEach(expr, bound, free);
+    }
+}
+
+// Returns the names (lambda . lambdaArgs) refers to freely, analysing it
+// the first time it is seen.
+Value *freeVariables(Value *lambdaArgs) {
+    FormTable *table = &currentInterpreter()->freeVariables;
+    pthread_mutex_lock(&table->lock);
+    if (table->capacity > 0) {
+        size_t slot = findForm(table, lambdaArgs);
+        if (table->keys[slot] != NULL) {
+            Value *names = table->values[slot];
+            pthread_mutex_unlock(&table->lock);
+            return names;
+        }
+    }
+    Value *names = makeNull();
+    findFreeLambda(lambdaArgs, makeNull(), &names);
+    if (table->count * 2 >= table->capacity) {
+        growFormTable(table);
+    }
+    size_t slot = findForm(table, lambdaArgs);
+    table->keys[slot] = lambdaArgs;
+    table->values[slot] = names;
+    table->count++;
+    pthread_mutex_unlock(&table->lock);
+    return names;
+}
+
+/* Definitions */
+
+// The code of a closure's own frame, where nothing runs.
+Value noCode = {.type = NULL_TYPE};
+
+// Answers kept in the definingCode table.
+Value definesAnswer = {.type = BOOL_TYPE, .i = 1};
+Value noDefinesAnswer = {.type = BOOL_TYPE, .i = 0};
+
+// Whether code contains a define outside of quoted data.
+int containsDefine(Value *code) {
+    if (code->type != CONS_TYPE) {
+        return 0;
+    }
+    if (car(code)->type == SYMBOL_TYPE) {
+        if (!strcmp(car(code)->s, "quote")) {
+            return 0;
+        } else if (!strcmp(car(code)->s, "define")) {
+            return 1;
+        }
+    }
+    for (; code->type == CONS_TYPE; code = cdr(code)) {
+        if (containsDefine(car(code))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether a define could still add a binding to frame or one of its
+// parents below global, looking at the code they run the first time each
+// is seen. A frame whose code isn't known could.
+int mayGainBindings(Frame *frame, Frame *global) {
+    FormTable *table = &currentInterpreter()->definingCode;
+    int defines = 0;
+    pthread_mutex_lock(&table->lock);
+    for (; frame != global && !defines; frame = frame->parent) {
+        if (frame->code == NULL) {
+            defines = 1;
+            break;
+        }
+        size_t slot = 0;
+        if (table->capacity > 0) {
+            slot = findForm(table, frame->code);
+        }
+        if (table->capacity == 0 || table->keys[slot] == NULL) {
+            if (table->count * 2 >= table->capacity) {
+                growFormTable(table);
+            }
+            slot = findForm(table, frame->code);
+            table->keys[slot] = frame->code;
+            table->values[slot] = containsDefine(frame->code)
+                                     ? &definesAnswer : &noDefinesAnswer;
+            table->count++;
+        }
+        defines = table->values[slot]->i;
+    }
+    pthread_mutex_unlock(&table->lock);
+    return defines;
+}
+
+/* Capture */
+
+// Returns the binding cell of name in frame, or NULL.
+Value *bindingIn(char *name, Frame *frame) {
+    for (Value *bindings = frame->bindings; bindings->type != NULL_TYPE;
+         bindings = cdr(bindings)) {
+        if (sameName(car(car(bindings))->s, name)) {
+            return car(bindings);
+        }
+    }
+    return NULL;
+}
+
+Frame *closureFrame(Value *lambdaArgs, Frame *frame) {
+    if (frame->parent == NULL) {
+        return frame;
+    }
+    Frame *global = frame;
+    while (global->parent != NULL) {
+        global = global->parent;
+    }
+    if (mayGainBindings(frame, global)) {
+        return frame;
+    }
+    Value *names = freeVariables(lambdaArgs);
+    Value *captured = makeNull();
+    for (; names->type != NULL_TYPE; names = cdr(names)) {
+        char *name = car(names)->s;
+        Value *cell = NULL;
+        for (Frame *scope = frame; scope != global && cell == NULL;
+             scope = scope->parent) {
+            cell = bindingIn(name, scope);
+        }
+        if (cell != NULL) {
+            captured = cons(cell, captured);
+        } else if (bindingIn(name, global) == NULL) {
+            return frame;
+        }
+    }
+    if (captured->type == NULL_TYPE) {
+        return global;
+    }
+    Frame *flat = talloc(sizeof(Frame));
+    COUNT_FRAME();
+    flat->bindings = captured;
+    flat->parent = global;
+    flat->code = &noCode;
+    return flat;
+}
@@ -0,0 +1,38 @@
+#include <pthread.h>
+#include "value.h"
+
+#ifndef _CLOSURE
+#define _CLOSURE
+
+// Flat closures. A closure keeps a frame of its own holding only the
+// binding cells of the variables its body refers to, found when it is
+// made, with the global frame as that frame's parent. The cells are shared
+// with the frames they came from, so set! is seen on both sides, and the
+// rest of the defining environment isn't kept alive by the closure. A
+// closure made where a define could still add a binding that hides one of
+// those cells keeps its whole environment instead.
+
+// What has been found out about forms evaluated so far, keyed by the form:
+// the variables each lambda expression refers to, keyed by its argument
+// list, and whether code run in a frame could define in it. Futures share
+// an instance across threads, so the tables are locked.
+typedef struct FormTable {
+    Value **keys;
+    Value **values;
+    size_t capacity;
+    size_t count;
+    pthread_mutex_t lock;
+} FormTable;
+
+void initFormTable(FormTable *table);
+void freeFormTable(FormTable *table);
+
+// Returns the frame a closure made by (lambda . lambdaArgs) in frame
+// should keep. That is the global frame when the body only refers to
+// globals, and frame itself when it refers to a name that isn't bound
+// anywhere yet, or when frame or one of its parents below the global frame
+// runs code with a define in it, either of which could still bind a name
+// the body refers to.
+Frame *closureFrame(Value *lambdaArgs, Frame *frame);
+
+#endif
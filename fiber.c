@@ -0,0 +1,326 @@
+/* Green threads and channels, switched with ucontext on lazily mapped
+ * stacks. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "fiber.h"
+#include "interpreter.h"
+#include "linkedlist.h"
+#include "output.h"
+#include "profiler.h"
+#include "stack.h"
+#include "talloc.h"
+
+// Room reserved for each task's stack. Only pages the task touches are
+// backed by memory; the lowest one is a guard, so running off the end is a
+// fault rather than a corruption of whatever is mapped below.
+#define STACK_SIZE (1024 * 1024)
+#define GUARD_SIZE 4096
+
+typedef struct Fiber {
+    ucontext_t context;
+    Value *thunk;
+    void *stack;
+    // The value handed over by channel-send to a task waiting to receive.
+    Value *received;
+    // Where eval stood on the task's stack when it last switched away.
+    EvalStack evalStack;
+    // The task's closures on the profiler's shadow stack, kept while it is
+    // switched away, and the room there is to keep them.
+    Value **shadowStack;
+    int shadowDepth;
+    int shadowCapacity;
+    struct Fiber *next;
+} Fiber;
+
+typedef struct Channel {
+    // Values sent but not yet received, oldest first.
+    Value *items;
+    Value *lastItem;
+    // Tasks waiting to receive, in the order they started waiting.
+    Fiber *waitingFirst;
+    Fiber *waitingLast;
+} Channel;
+
+// A stack no longer in use, kept to be given to the next task spawned.
+typedef struct FreeStack {
+    struct FreeStack *next;
+} FreeStack;
+
+// Each thread schedules its own tasks. The thread's own stack runs as the
+// main fiber.
+_Thread_local Fiber mainFiber;
+_Thread_local Fiber *currentFiber = NULL;
+_Thread_local Fiber *runnableFirst = NULL;
+_Thread_local Fiber *runnableLast = NULL;
+// A task that has finished but whose stack was still in use when it did.
+_Thread_local Fiber *finishedFiber = NULL;
+_Thread_local FreeStack *freeStacks = NULL;
+
+Fiber *runningFiber() {
+    if (currentFiber == NULL) {
+        currentFiber = &mainFiber;
+    }
+    return currentFiber;
+}
+
+void makeRunnable(Fiber *fiber) {
+    fiber->next = NULL;
+    if (runnableLast == NULL) {
+        runnableFirst = fiber;
+    } else {
+        runnableLast->next = fiber;
+    }
+    runnableLast = fiber;
+}
+
+Fiber *takeRunnable() {
+    Fiber *fiber = runnableFirst;
+    if (fiber != NULL) {
+        runnableFirst = fiber->next;
+        if (runnableFirst == NULL) {
+            runnableLast = NULL;
+        }
+    }
+    return fiber;
+}
+
+// The free list link of a stack sits just above its guard page.
+FreeStack *stackLink(void *stack) {
+    return (FreeStack *)((char *)stack + GUARD_SIZE);
+}
+
+void *newStack() {
+    if (freeStacks != NULL) {
+        FreeStack *link = freeStacks;
+        freeStacks = link->next;
+        return (char *)link - GUARD_SIZE;
+    }
+    void *stack = mmap(NULL, STACK_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (stack == MAP_FAILED) {
+        evalError("could not allocate a stack for spawn");
+    }
+    mprotect(stack, GUARD_SIZE, PROT_NONE);
+    return stack;
+}
+
+// Puts the stack of a task that finished before the last switch up for
+// reuse, now that nothing is running on it.
+void reapFinished() {
+    if (finishedFiber != NULL) {
+        FreeStack *link = stackLink(finishedFiber->stack);
+        link->next = freeStacks;
+        freeStacks = link;
+        finishedFiber = NULL;
+    }
+}
+
+// Keeps the thread's shadow stack in fiber as it switches away, when the
+// profiler is running.
+void saveShadowStack(Fiber *fiber) {
+    if (!profilerRunning) {
+        return;
+    }
+    int kept = shadowDepth < SHADOW_STACK_SIZE ? shadowDepth
+                                               : SHADOW_STACK_SIZE;
+    if (kept > fiber->shadowCapacity) {
+        fiber->shadowStack = talloc(kept * sizeof(Value *));
+        fiber->shadowCapacity = kept;
+    }
+    memcpy(fiber->shadowStack, shadowStack, kept * sizeof(Value *));
+    fiber->shadowDepth = shadowDepth;
+}
+
+// Puts back the shadow stack fiber had when it switched away.
+void restoreShadowStack(Fiber *fiber) {
+    if (!profilerRunning) {
+        return;
+    }
+    int kept = fiber->shadowDepth < SHADOW_STACK_SIZE ? fiber->shadowDepth
+                                                      : SHADOW_STACK_SIZE;
+    //a sample taken while copying sees an empty stack, not a mix of two
+    shadowDepth = 0;
+    if (kept > 0) {
+        memcpy(shadowStack, fiber->shadowStack, kept * sizeof(Value *));
+    }
+    shadowDepth = fiber->shadowDepth;
+}
+
+// Switches from the running fiber to the next runnable one. The running
+// fiber must already be queued somewhere it will be resumed from, or be
+// finished.
+void switchFibers() {
+    Fiber *previous = runningFiber();
+    Fiber *next = takeRunnable();
+    if (next == NULL) {
+        evalError("deadlock: every task is waiting on a channel");
+    }
+    if (next == previous) {
+        return;
+    }
+    currentFiber = next;
+    previous->evalStack = evalStack;
+    evalStack = next->evalStack;
+    saveShadowStack(previous);
+    restoreShadowStack(next);
+    swapcontext(&previous->context, &next->context);
+    reapFinished();
+}
+
+void startFiber() {
+    reapFinished();
+    Fiber *fiber = runningFiber();
+    apply(fiber->thunk, makeNull());
+    finishedFiber = fiber;
+    Fiber *next = takeRunnable();
+    if (next == NULL) {
+        evalError("deadlock: every task is waiting on a channel");
+    }
+    currentFiber = next;
+    evalStack = next->evalStack;
+    restoreShadowStack(next);
+    setcontext(&next->context);
+}
+
+Value *makeVoid() {
+    Value *voidVal = makeNull();
+    voidVal->type = VOID_TYPE;
+    return voidVal;
+}
+
+Value *primitiveSpawn(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for spawn");
+    } else if (car(args)->type != CLOSURE_TYPE &&
+               car(args)->type != PRIMITIVE_TYPE) {
+        evalError("spawn expects a procedure");
+    }
+    Fiber *fiber = talloc(sizeof(Fiber));
+    fiber->thunk = car(args);
+    fiber->received = NULL;
+    fiber->shadowStack = NULL;
+    fiber->shadowDepth = 0;
+    fiber->shadowCapacity = 0;
+    fiber->stack = newStack();
+    fiber->evalStack = newEvalStack(stackLink(fiber->stack) + 1);
+    getcontext(&fiber->context);
+    //the guard page and the free list link are below the usable stack
+    fiber->context.uc_stack.ss_sp = stackLink(fiber->stack) + 1;
+    fiber->context.uc_stack.ss_size = STACK_SIZE - GUARD_SIZE -
+                                      sizeof(FreeStack);
+    fiber->context.uc_link = NULL;
+    makecontext(&fiber->context, startFiber, 0);
+    makeRunnable(fiber);
+    return makeVoid();
+}
+
+Value *primitiveYield(Value *args) {
+    if (length(args) != 0) {
+        evalError("wrong number of args for yield");
+    }
+    makeRunnable(runningFiber());
+    switchFibers();
+    return makeVoid();
+}
+
+Value *primitiveMakeChannel(Value *args) {
+    if (length(args) != 0) {
+        evalError("wrong number of args for make-channel");
+    }
+    Channel *channel = talloc(sizeof(Channel));
+    channel->items = makeNull();
+    channel->lastItem = NULL;
+    channel->waitingFirst = NULL;
+    channel->waitingLast = NULL;
+    Value *value = makeNull();
+    value->type = CHANNEL_TYPE;
+    value->p = channel;
+    return value;
+}
+
+Value *primitiveChannelSend(Value *args) {
+    if (length(args) != 2) {
+        evalError("wrong number of args for channel-send");
+    } else if (car(args)->type != CHANNEL_TYPE) {
+        evalError("channel-send expects a channel");
+    }
+    Channel *channel = car(args)->p;
+    Value *item = car(cdr(args));
+    Fiber *receiver = channel->waitingFirst;
+    if (receiver != NULL) {
+        channel->waitingFirst = receiver->next;
+        if (channel->waitingFirst == NULL) {
+            channel->waitingLast = NULL;
+        }
+        receiver->received = item;
+        makeRunnable(receiver);
+        return makeVoid();
+    }
+    Value *cell = cons(item, makeNull());
+    if (channel->lastItem == NULL) {
+        channel->items = cell;
+    } else {
+        channel->lastItem->c.cdr = cell;
+    }
+    channel->lastItem = cell;
+    return makeVoid();
+}
+
+Value *primitiveChannelRecv(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for channel-recv");
+    } else if (car(args)->type != CHANNEL_TYPE) {
+        evalError("channel-recv expects a channel");
+    }
+    Channel *channel = car(args)->p;
+    if (channel->items->type != NULL_TYPE) {
+        Value *item = car(channel->items);
+        channel->items = cdr(channel->items);
+        if (channel->items->type == NULL_TYPE) {
+            channel->lastItem = NULL;
+        }
+        return item;
+    }
+    Fiber *fiber = runningFiber();
+    fiber->next = NULL;
+    if (channel->waitingLast == NULL) {
+        channel->waitingFirst = fiber;
+    } else {
+        channel->waitingLast->next = fiber;
+    }
+    channel->waitingLast = fiber;
+    switchFibers();
+    Value *item = fiber->received;
+    fiber->received = NULL;
+    return item;
+}
+
+void settleFibers() {
+    if (runningFiber() != &mainFiber) {
+        return;
+    }
+    while (runnableFirst != NULL) {
+        makeRunnable(&mainFiber);
+        switchFibers();
+    }
+}
+
+// Tasks waiting on a channel can't be found from here, so their stacks stay
+// mapped; the others' go back on the free list.
+void abandonFibers() {
+    reapFinished();
+    Fiber *fiber = runningFiber();
+    if (fiber != &mainFiber) {
+        restoreShadowStack(&mainFiber);
+    }
+    for (; fiber != NULL; fiber = takeRunnable()) {
+        if (fiber != &mainFiber) {
+            finishedFiber = fiber;
+            reapFinished();
+        }
+    }
+    currentFiber = &mainFiber;
+}
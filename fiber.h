@@ -0,0 +1,40 @@
+#include "value.h"
+
+#ifndef _FIBER
+#define _FIBER
+
+// Green threads: lightweight tasks that take turns on the thread that
+// spawned them. Each one runs on its own small stack, mapped lazily so that
+// an idle task costs only the few pages it has touched. A task runs until it
+// yields, waits on an empty channel, or finishes; the next runnable task then
+// continues, in the order they became runnable.
+
+// (spawn thunk): makes a task that will apply thunk, a procedure of no
+// arguments, and queues it to run.
+Value *primitiveSpawn(Value *args);
+
+// (yield): lets every other runnable task have a turn before continuing.
+Value *primitiveYield(Value *args);
+
+// (make-channel): returns a new channel, an unbounded queue of values.
+Value *primitiveMakeChannel(Value *args);
+
+// (channel-send channel value): queues value on channel, waking a task
+// waiting to receive if there is one. Never waits.
+Value *primitiveChannelSend(Value *args);
+
+// (channel-recv channel): takes the oldest value from channel, waiting
+// until one is sent if it is empty. It is an error to wait when no other
+// task can run.
+Value *primitiveChannelRecv(Value *args);
+
+// Called by the top level between forms: runs spawned tasks until every one
+// has finished or is waiting on a channel. Does nothing inside a task.
+void settleFibers();
+
+// Called back on the thread's own stack after an error has abandoned the
+// evaluation that spawned the thread's tasks: drops them, and the task the
+// error happened in, so the next evaluation starts with none.
+void abandonFibers();
+
+#endif
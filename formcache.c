@@ -0,0 +1,360 @@
+/* Binary serialization of parsed forms, for skipping the tokenizer and
+ * parser on source files that haven't changed. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "formcache.h"
+#include "linkedlist.h"
+#include "parser.h"
+#include "talloc.h"
+
+// A cache file is a header followed by the encoded forms. Each datum is a tag
+// byte and its payload; strings and symbols are stored null-terminated, so
+// once the file is read into memory the values can point straight into it.
+// A list is stored as its item count, the items, and then its final cdr.
+#define CACHE_MAGIC 0x43464353u
+// Bump when the encoding changes, so old cache files are ignored.
+#define CACHE_VERSION 2
+
+typedef struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t readerVersion;
+    uint32_t unused;
+    uint64_t sourceHash;
+    uint64_t sourceLength;
+    uint64_t valueCount;
+    uint64_t dataLength;
+} CacheHeader;
+
+enum {
+    INT_TAG = 'i', DOUBLE_TAG = 'd', TRUE_TAG = 't', FALSE_TAG = 'f',
+    STRING_TAG = 's', SYMBOL_TAG = 'y', NULL_TAG = 'n', LIST_TAG = 'l'
+};
+
+uint64_t hashSource(const char *text, size_t length) {
+    //a word at a time, multiply and rotate; collisions only cost a
+    //reparse if the length also matches, which it rarely will
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    uint64_t hash = length * multiplier;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, text + i, 8);
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * multiplier;
+    }
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Fills path with the cache file name for the given hash and this build's
+// reader, so that builds with different readers sharing a directory don't
+// replace each other's files. Returns 0 if caching is turned off.
+int cachePath(uint64_t hash, char *path, size_t size) {
+    const char *directory = getenv("SCHEME_CACHE_DIR");
+    if (directory != NULL) {
+        if (directory[0] == '\0') {
+            return 0;
+        }
+        snprintf(path, size, "%s/%016llx.r%d.fc", directory,
+                 (unsigned long long)hash, READER_VERSION);
+        return 1;
+    }
+    const char *home = getenv("HOME");
+    if (home == NULL) {
+        return 0;
+    }
+    snprintf(path, size, "%s/.cache/scheme-interpreter/%016llx.r%d.fc",
+             home, (unsigned long long)hash, READER_VERSION);
+    return 1;
+}
+
+// Creates every missing directory leading up to the file at path.
+void makeParentDirectories(char *path) {
+    for (char *slash = strchr(path + 1, '/'); slash != NULL;
+         slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+}
+
+/* Writing */
+
+typedef struct Encoder {
+    char *data;
+    size_t length;
+    size_t capacity;
+    uint64_t valueCount;
+} Encoder;
+
+void encodeBytes(Encoder *encoder, const void *bytes, size_t length) {
+    if (encoder->length + length > encoder->capacity) {
+        while (encoder->length + length > encoder->capacity) {
+            encoder->capacity = encoder->capacity ? encoder->capacity * 2 : 4096;
+        }
+        encoder->data = realloc(encoder->data, encoder->capacity);
+    }
+    memcpy(encoder->data + encoder->length, bytes, length);
+    encoder->length += length;
+}
+
+void encodeTag(Encoder *encoder, char tag) {
+    encodeBytes(encoder, &tag, 1);
+}
+
+// Encodes item, returning 0 if it holds something that can't be cached.
+int encodeValue(Encoder *encoder, Value *item) {
+    encoder->valueCount++;
+    switch (item->type) {
+        case INT_TYPE: {
+            int32_t number = item->i;
+            encodeTag(encoder, INT_TAG);
+            encodeBytes(encoder, &number, sizeof(number));
+            return 1;
+        }
+        case DOUBLE_TYPE:
+            encodeTag(encoder, DOUBLE_TAG);
+            encodeBytes(encoder, &item->d, sizeof(item->d));
+            return 1;
+        case BOOL_TYPE:
+            encodeTag(encoder, item->i ? TRUE_TAG : FALSE_TAG);
+            return 1;
+        case STR_TYPE:
+        case SYMBOL_TYPE: {
+            uint32_t length = strlen(item->s);
+            encodeTag(encoder, item->type == STR_TYPE ? STRING_TAG : SYMBOL_TAG);
+            encodeBytes(encoder, &length, sizeof(length));
+            encodeBytes(encoder, item->s, length + 1);
+            return 1;
+        }
+        case NULL_TYPE:
+            encodeTag(encoder, NULL_TAG);
+            return 1;
+        case CONS_TYPE: {
+            uint32_t count = 0;
+            Value *tail = item;
+            while (tail->type == CONS_TYPE) {
+                count++;
+                tail = cdr(tail);
+            }
+            encoder->valueCount += count - 1;
+            encodeTag(encoder, LIST_TAG);
+            encodeBytes(encoder, &count, sizeof(count));
+            while (item->type == CONS_TYPE) {
+                if (!encodeValue(encoder, car(item))) {
+                    return 0;
+                }
+                item = cdr(item);
+            }
+            return encodeValue(encoder, item);
+        }
+        default:
+            return 0;
+    }
+}
+
+void writeFormCache(uint64_t hash, size_t sourceLength, Value *forms) {
+    char path[4096];
+    if (!cachePath(hash, path, sizeof(path))) {
+        return;
+    }
+    Encoder encoder = {NULL, 0, 0, 0};
+    if (!encodeValue(&encoder, forms)) {
+        free(encoder.data);
+        return;
+    }
+    CacheHeader header = {CACHE_MAGIC, CACHE_VERSION, READER_VERSION, 0,
+                          hash, sourceLength, encoder.valueCount,
+                          encoder.length};
+    //write to a private name and rename into place, so readers never see a
+    //partial file
+    char temporary[4200];
+    snprintf(temporary, sizeof(temporary), "%s.%d", path, (int)getpid());
+    makeParentDirectories(temporary);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(encoder.data);
+        return;
+    }
+    int ok = write(fd, &header, sizeof(header)) == sizeof(header) &&
+             write(fd, encoder.data, encoder.length) == (ssize_t)encoder.length;
+    close(fd);
+    free(encoder.data);
+    if (!ok || rename(temporary, path) < 0) {
+        unlink(temporary);
+    }
+}
+
+/* Reading */
+
+typedef struct Decoder {
+    char *data;
+    char *end;
+    Value *values;
+    Value *valuesEnd;
+} Decoder;
+
+// Returns the next of the preallocated values, or NULL if the file claims
+// more than its header said.
+Value *nextValue(Decoder *decoder) {
+    if (decoder->values == decoder->valuesEnd) {
+        return NULL;
+    }
+    return decoder->values++;
+}
+
+int available(Decoder *decoder, size_t length) {
+    return (size_t)(decoder->end - decoder->data) >= length;
+}
+
+// Decodes one datum, returning NULL if the data is malformed.
+Value *decodeValue(Decoder *decoder) {
+    if (!available(decoder, 1)) {
+        return NULL;
+    }
+    char tag = *decoder->data++;
+    if (tag == LIST_TAG) {
+        uint32_t count;
+        if (!available(decoder, sizeof(count))) {
+            return NULL;
+        }
+        memcpy(&count, decoder->data, sizeof(count));
+        decoder->data += sizeof(count);
+        Value *list = NULL;
+        Value *last = NULL;
+        for (uint32_t i = 0; i < count; i++) {
+            Value *cell = nextValue(decoder);
+            if (cell == NULL) {
+                return NULL;
+            }
+            cell->type = CONS_TYPE;
+            cell->c.car = decodeValue(decoder);
+            if (cell->c.car == NULL) {
+                return NULL;
+            }
+            if (last == NULL) {
+                list = cell;
+            } else {
+                last->c.cdr = cell;
+            }
+            last = cell;
+        }
+        Value *tail = decodeValue(decoder);
+        if (tail == NULL || last == NULL) {
+            return NULL;
+        }
+        last->c.cdr = tail;
+        return list;
+    }
+    Value *item = nextValue(decoder);
+    if (item == NULL) {
+        return NULL;
+    }
+    switch (tag) {
+        case INT_TAG: {
+            int32_t number;
+            if (!available(decoder, sizeof(number))) {
+                return NULL;
+            }
+            memcpy(&number, decoder->data, sizeof(number));
+            decoder->data += sizeof(number);
+            item->type = INT_TYPE;
+            item->i = number;
+            return item;
+        }
+        case DOUBLE_TAG:
+            if (!available(decoder, sizeof(double))) {
+                return NULL;
+            }
+            memcpy(&item->d, decoder->data, sizeof(double));
+            decoder->data += sizeof(double);
+            item->type = DOUBLE_TYPE;
+            return item;
+        case TRUE_TAG:
+        case FALSE_TAG:
+            item->type = BOOL_TYPE;
+            item->i = tag == TRUE_TAG;
+            return item;
+        case STRING_TAG:
+        case SYMBOL_TAG: {
+            uint32_t length;
+            if (!available(decoder, sizeof(length))) {
+                return NULL;
+            }
+            memcpy(&length, decoder->data, sizeof(length));
+            decoder->data += sizeof(length);
+            if (!available(decoder, (size_t)length + 1) ||
+                decoder->data[length] != '\0') {
+                return NULL;
+            }
+            item->type = tag == STRING_TAG ? STR_TYPE : SYMBOL_TYPE;
+            item->s = decoder->data;
+            decoder->data += length + 1;
+            return item;
+        }
+        case NULL_TAG:
+            item->type = NULL_TYPE;
+            return item;
+        default:
+            return NULL;
+    }
+}
+
+Value *readFormCache(uint64_t hash, size_t sourceLength) {
+    char path[4096];
+    if (!cachePath(hash, path, sizeof(path))) {
+        return NULL;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    CacheHeader header;
+    struct stat info;
+    if (fstat(fd, &info) < 0 ||
+        read(fd, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != CACHE_MAGIC || header.version != CACHE_VERSION ||
+        header.readerVersion != READER_VERSION ||
+        header.sourceHash != hash || header.sourceLength != sourceLength ||
+        (uint64_t)info.st_size != sizeof(header) + header.dataLength) {
+        close(fd);
+        return NULL;
+    }
+    //the data stays allocated for as long as the forms do, since strings
+    //and symbols point into it
+    Decoder decoder;
+    decoder.data = talloc(header.dataLength);
+    decoder.end = decoder.data + header.dataLength;
+    decoder.values = talloc(header.valueCount * sizeof(Value));
+    decoder.valuesEnd = decoder.values + header.valueCount;
+    size_t total = 0;
+    while (total < header.dataLength) {
+        ssize_t result = read(fd, decoder.data + total,
+                              header.dataLength - total);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result <= 0) {
+            break;
+        }
+        total += result;
+    }
+    close(fd);
+    if (total != header.dataLength) {
+        return NULL;
+    }
+    Value *forms = decodeValue(&decoder);
+    if (forms == NULL || decoder.data != decoder.end ||
+        decoder.values != decoder.valuesEnd) {
+        return NULL;
+    }
+    return forms;
+}
@@ -0,0 +1,26 @@
+#include <stddef.h>
+#include <stdint.h>
+#include "value.h"
+
+#ifndef _FORMCACHE
+#define _FORMCACHE
+
+// A cache of parsed top-level forms in a compact binary file, so that a
+// source file seen before can be loaded with one read instead of being
+// tokenized and parsed again. Cache files are named by a hash of the source
+// text and the READER_VERSION that parsed it, and live in $SCHEME_CACHE_DIR,
+// or ~/.cache/scheme-interpreter if that isn't set. Setting SCHEME_CACHE_DIR to an empty string turns caching off.
+
+// Hash the text of a source file, for use as its cache key.
+uint64_t hashSource(const char *text, size_t length);
+
+// Returns the list of forms cached for source text with the given hash and
+// length, or NULL if there is no usable cache file.
+Value *readFormCache(uint64_t hash, size_t sourceLength);
+
+// Writes forms, as returned by the parser, to the cache for source text with
+// the given hash and length. Failures are ignored; the cache is only an
+// optimization.
+void writeFormCache(uint64_t hash, size_t sourceLength, Value *forms);
+
+#endif
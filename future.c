@@ -0,0 +1,380 @@
+/* A work-stealing thread pool for futures and pmap. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "future.h"
+#include "interpreter.h"
+#include "linkedlist.h"
+#include "fiber.h"
+#include "output.h"
+#include "stack.h"
+#include "talloc.h"
+
+// A failed task raised an error, which was printed where it ran.
+enum { TASK_PENDING, TASK_RUNNING, TASK_DONE, TASK_FAILED };
+
+// A unit of work. With count 0 it is a future: function applied to args.
+// Otherwise it maps function over the first count items of args, giving a
+// list of the results.
+typedef struct Task {
+    // The instance that submitted the task, whose tables it runs with.
+    Interpreter *owner;
+    Value *function;
+    Value *args;
+    int count;
+    Value *result;
+    atomic_int state;
+    // The forkGeneration of the process that started running the task.
+    unsigned generation;
+} Task;
+
+// A worker's tasks. The owner pushes and pops at the bottom; other threads
+// steal from the top, so old, usually larger, work is what moves.
+typedef struct Deque {
+    pthread_mutex_t lock;
+    Task **tasks;
+    size_t capacity;
+    size_t top;
+    size_t bottom;
+} Deque;
+
+int workerCount = 0;
+Deque *deques = NULL;
+// Index of the current thread's deque, or -1 off the pool.
+_Thread_local int workerIndex = -1;
+atomic_int queuedTasks = 0;
+atomic_uint nextDeque = 0;
+pthread_once_t poolStarted = PTHREAD_ONCE_INIT;
+pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t workAvailable = PTHREAD_COND_INITIALIZER;
+pthread_cond_t taskFinished = PTHREAD_COND_INITIALIZER;
+// How many forks lie between the first process and this one.
+unsigned forkGeneration = 0;
+pthread_once_t forkHandlerRegistered = PTHREAD_ONCE_INIT;
+
+void pushTask(Deque *deque, Task *task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom - deque->top == deque->capacity) {
+        size_t capacity = deque->capacity ? deque->capacity * 2 : 256;
+        Task **tasks = malloc(capacity * sizeof(Task *));
+        for (size_t i = deque->top; i < deque->bottom; i++) {
+            tasks[i % capacity] = deque->tasks[i % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity = capacity;
+    }
+    deque->tasks[deque->bottom % deque->capacity] = task;
+    deque->bottom++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+Task *popTask(Deque *deque, int fromTop) {
+    Task *task = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top) {
+        if (fromTop) {
+            task = deque->tasks[deque->top % deque->capacity];
+            deque->top++;
+        } else {
+            deque->bottom--;
+            task = deque->tasks[deque->bottom % deque->capacity];
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+    if (task != NULL) {
+        atomic_fetch_sub(&queuedTasks, 1);
+    }
+    return task;
+}
+
+// Takes a task from this thread's own deque, or steals one, starting the
+// search at a different deque each time so thieves spread out.
+Task *findTask() {
+    if (workerIndex >= 0) {
+        Task *task = popTask(&deques[workerIndex], 0);
+        if (task != NULL) {
+            return task;
+        }
+    }
+    unsigned start = atomic_fetch_add(&nextDeque, 1);
+    for (int i = 0; i < workerCount; i++) {
+        int victim = (start + i) % workerCount;
+        if (victim != workerIndex) {
+            Task *task = popTask(&deques[victim], 1);
+            if (task != NULL) {
+                return task;
+            }
+        }
+    }
+    return NULL;
+}
+
+void finishTask(Task *task, Value *result, int state) {
+    task->result = result;
+    pthread_mutex_lock(&poolLock);
+    atomic_store(&task->state, state);
+    pthread_cond_broadcast(&taskFinished);
+    pthread_mutex_unlock(&poolLock);
+}
+
+// Whether task has finished, one way or the other.
+int taskSettled(Task *task) {
+    int state = atomic_load(&task->state);
+    return state == TASK_DONE || state == TASK_FAILED;
+}
+
+// Runs task unless another thread has already claimed it.
+void runTask(Task *task) {
+    int expected = TASK_PENDING;
+    if (!atomic_compare_exchange_strong(&task->state, &expected,
+                                        TASK_RUNNING)) {
+        return;
+    }
+    task->generation = forkGeneration;
+    Interpreter *previous = borrowInterpreter(task->owner);
+    EvalStack stack = evalStack;
+    jmp_buf *outer = errorExit;
+    jmp_buf handler;
+    if (setjmp(handler) != 0) {
+        //an error in the task ends it rather than the program
+        errorExit = outer;
+        evalStack = stack;
+        abandonFibers();
+        outFlush();
+        borrowInterpreter(previous);
+        finishTask(task, NULL, TASK_FAILED);
+        return;
+    }
+    errorExit = &handler;
+    Value *result;
+    if (task->count == 0) {
+        result = apply(task->function, task->args);
+    } else {
+        result = makeNull();
+        Value *last = NULL;
+        Value *items = task->args;
+        for (int i = 0; i < task->count; i++) {
+            Value *cell = cons(apply(task->function,
+                                     cons(car(items), makeNull())),
+                               makeNull());
+            if (last == NULL) {
+                result = cell;
+            } else {
+                last->c.cdr = cell;
+            }
+            last = cell;
+            items = cdr(items);
+        }
+    }
+    errorExit = outer;
+    //anything printed by the task shouldn't wait on this thread's buffer
+    outFlush();
+    borrowInterpreter(previous);
+    finishTask(task, result, TASK_DONE);
+}
+
+void *workerLoop(void *argument) {
+    workerIndex = (int)(long)argument;
+    while (1) {
+        Task *task = findTask();
+        if (task != NULL) {
+            runTask(task);
+            continue;
+        }
+        pthread_mutex_lock(&poolLock);
+        while (atomic_load(&queuedTasks) == 0) {
+            pthread_cond_wait(&workAvailable, &poolLock);
+        }
+        pthread_mutex_unlock(&poolLock);
+    }
+    return NULL;
+}
+
+// A forked child has none of the workers, so it forgets the pool and starts
+// its own the next time one is needed. Tasks still queued in the parent's
+// deques are run by whoever touches them. Tasks that threads of the parent
+// were running will never finish here; waitForTask finds them by their
+// generation and fails them.
+void forgetPool() {
+    forkGeneration++;
+    pthread_once_t notStarted = PTHREAD_ONCE_INIT;
+    poolStarted = notStarted;
+    workerCount = 0;
+    deques = NULL;
+    workerIndex = -1;
+    atomic_store(&queuedTasks, 0);
+    pthread_mutex_init(&poolLock, NULL);
+    pthread_cond_init(&workAvailable, NULL);
+    pthread_cond_init(&taskFinished, NULL);
+}
+
+void registerForkHandler() {
+    pthread_atfork(NULL, NULL, forgetPool);
+}
+
+void startPool() {
+    pthread_once(&forkHandlerRegistered, registerForkHandler);
+    char *requested = getenv("SCHEME_THREADS");
+    workerCount = requested != NULL ? atoi(requested)
+                                    : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workerCount < 1) {
+        workerCount = 1;
+    }
+    deques = calloc(workerCount, sizeof(Deque));
+    for (int i = 0; i < workerCount; i++) {
+        pthread_mutex_init(&deques[i].lock, NULL);
+    }
+    for (int i = 0; i < workerCount; i++) {
+        pthread_t thread;
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+        //evaluation recurses on the C stack, so give workers as much as
+        //the main thread usually has
+        pthread_attr_setstacksize(&attributes, 8 << 20);
+        pthread_create(&thread, &attributes, workerLoop, (void *)(long)i);
+        pthread_attr_destroy(&attributes);
+        pthread_detach(thread);
+    }
+}
+
+// Queues task on this thread's deque, or spreads tasks from outside the
+// pool across the workers.
+void submitTask(Task *task) {
+    pthread_once(&poolStarted, startPool);
+    int target = workerIndex;
+    if (target < 0) {
+        target = atomic_fetch_add(&nextDeque, 1) % workerCount;
+    }
+    atomic_fetch_add(&queuedTasks, 1);
+    pushTask(&deques[target], task);
+    pthread_mutex_lock(&poolLock);
+    pthread_cond_signal(&workAvailable);
+    pthread_mutex_unlock(&poolLock);
+}
+
+Task *newTask(Value *function, Value *args, int count) {
+    Task *task = talloc(sizeof(Task));
+    task->owner = currentInterpreter();
+    task->function = function;
+    task->args = args;
+    task->count = count;
+    task->result = NULL;
+    atomic_init(&task->state, TASK_PENDING);
+    task->generation = forkGeneration;
+    return task;
+}
+
+// Waits for task to finish, running it here if nobody has started it and
+// running other tasks while it is in progress elsewhere. A failed task is
+// an error here too.
+Value *waitForTask(Task *task) {
+    runTask(task);
+    if (atomic_load(&task->state) == TASK_RUNNING &&
+        task->generation != forkGeneration) {
+        //a thread of the parent was running it when this process forked
+        atomic_store(&task->state, TASK_FAILED);
+        evalError("touched a future whose task was running when the "
+                  "process forked");
+    }
+    while (!taskSettled(task)) {
+        Task *other = findTask();
+        if (other != NULL) {
+            runTask(other);
+            continue;
+        }
+        pthread_mutex_lock(&poolLock);
+        if (!taskSettled(task)) {
+            pthread_cond_wait(&taskFinished, &poolLock);
+        }
+        pthread_mutex_unlock(&poolLock);
+    }
+    if (atomic_load(&task->state) == TASK_FAILED) {
+        evalError("touched a future whose task raised an error");
+    }
+    return task->result;
+}
+
+Value *primitiveFuture(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for future");
+    } else if (car(args)->type != CLOSURE_TYPE &&
+               car(args)->type != PRIMITIVE_TYPE) {
+        evalError("future expects a procedure");
+    }
+    //keep output printed so far ahead of anything the task prints
+    outFlush();
+    Task *task = newTask(car(args), makeNull(), 0);
+    submitTask(task);
+    Value *future = makeNull();
+    future->type = FUTURE_TYPE;
+    future->p = task;
+    return future;
+}
+
+Value *primitiveTouch(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for touch");
+    }
+    if (car(args)->type != FUTURE_TYPE) {
+        return car(args);
+    }
+    return waitForTask(car(args)->p);
+}
+
+Value *primitivePmap(Value *args) {
+    if (length(args) != 2) {
+        evalError("wrong number of args for pmap");
+    } else if (car(args)->type != CLOSURE_TYPE &&
+               car(args)->type != PRIMITIVE_TYPE) {
+        evalError("pmap expects a procedure");
+    }
+    Value *function = car(args);
+    Value *items = car(cdr(args));
+    if (items->type != CONS_TYPE && items->type != NULL_TYPE) {
+        evalError("pmap expects a list");
+    }
+    int count = length(items);
+    if (count == 0) {
+        return makeNull();
+    }
+    outFlush();
+    pthread_once(&poolStarted, startPool);
+    //enough chunks per worker that stealing can even out uneven items
+    int chunkSize = count / (workerCount * 8);
+    if (chunkSize < 1) {
+        chunkSize = 1;
+    }
+    int chunkCount = (count + chunkSize - 1) / chunkSize;
+    Task **chunks = talloc(chunkCount * sizeof(Task *));
+    for (int i = 0; i < chunkCount; i++) {
+        int size = count - i * chunkSize < chunkSize ? count - i * chunkSize
+                                                     : chunkSize;
+        chunks[i] = newTask(function, items, size);
+        submitTask(chunks[i]);
+        for (int j = 0; j < size; j++) {
+            items = cdr(items);
+        }
+    }
+    //splice the chunks' result lists together in order
+    Value *result = makeNull();
+    Value *last = NULL;
+    for (int i = 0; i < chunkCount; i++) {
+        Value *chunk = waitForTask(chunks[i]);
+        if (last == NULL) {
+            result = chunk;
+        } else {
+            last->c.cdr = chunk;
+        }
+        while (cdr(chunk)->type != NULL_TYPE) {
+            chunk = cdr(chunk);
+        }
+        last = chunk;
+    }
+    return result;
+}
@@ -0,0 +1,29 @@
+#include "value.h"
+
+#ifndef _FUTURE
+#define _FUTURE
+
+// Futures and parallel map, run on a pool of worker threads started the
+// first time either is used. Each worker keeps its own deque of tasks, works
+// from the bottom of it, and steals from the top of the others' when it runs
+// out. The pool has one worker per core, or $SCHEME_THREADS workers if set.
+// Closures run on workers allocate from that worker's own talloc blocks, so
+// they should not define or set! shared variables. A process forked while
+// tasks run, such as a server worker or batch script, can't finish the ones
+// that were running: touching them there is an error.
+
+// (future thunk): starts running thunk, a procedure of no arguments, and
+// returns a future for its result.
+Value *primitiveFuture(Value *args);
+
+// (touch future): waits for future to finish and returns its result. A
+// waiting thread runs other queued tasks in the meantime. If the task raised
+// an error, which is printed when it happens, touching it is an error too.
+// Touching anything other than a future returns it unchanged.
+Value *primitiveTouch(Value *args);
+
+// (pmap f list): like map over one list, with chunks of the list mapped in
+// parallel. The result keeps the order of list.
+Value *primitivePmap(Value *args);
+
+#endif
@@ -0,0 +1,473 @@
+/* Saving and loading heap images. An image holds copies of the reachable
+ * Values, Frames and strings laid out exactly as they are in memory, except
+ * that pointers are stored as offsets from the start of the file and
+ * primitive functions as their position in the interpreter's primitive
+ * table. Loading maps the file and turns those back into pointers. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "image.h"
+#include "interpreter.h"
+#include "linkedlist.h"
+#include "macro.h"
+#include "output.h"
+#include "talloc.h"
+
+#define IMAGE_MAGIC 0x474D4953u
+#define IMAGE_VERSION 2
+
+typedef struct ImageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t valueSize;
+    uint32_t frameSize;
+    uint64_t valueCount;
+    uint64_t frameCount;
+    uint64_t valuesOffset;
+    uint64_t framesOffset;
+    uint64_t stringsOffset;
+    uint64_t fileSize;
+    uint64_t topFrame;
+    // The macro table, as a list from macroDefinitions, and its count of
+    // renamed binders.
+    uint64_t macros;
+    uint64_t macroRenames;
+} ImageHeader;
+
+void imageError(char *message, char *path) {
+    outString("Image error: ");
+    outString(message);
+    outString(": ");
+    outString(path);
+    outChar('\n');
+    outFlush();
+    texit(1);
+}
+
+/* Saving */
+
+enum { VALUE_OBJECT, FRAME_OBJECT, STRING_OBJECT };
+
+// An object whose own pointers haven't been followed yet.
+typedef struct PendingObject {
+    void *object;
+    int kind;
+} PendingObject;
+
+// Everything found so far, with an open-addressing table from each object's
+// address to its kind and position in the image.
+typedef struct Snapshot {
+    void **keys;
+    uint64_t *slots;
+    size_t tableSize;
+    size_t used;
+    Value **values;
+    size_t valueCount;
+    size_t valueCapacity;
+    Frame **frames;
+    size_t frameCount;
+    size_t frameCapacity;
+    char **strings;
+    size_t stringCount;
+    size_t stringCapacity;
+    uint64_t stringBytes;
+    PendingObject *pending;
+    size_t pendingCount;
+    size_t pendingCapacity;
+} Snapshot;
+
+size_t hashPointer(void *pointer, size_t tableSize) {
+    uint64_t key = (uint64_t)(uintptr_t)pointer;
+    key = (key ^ (key >> 33)) * 0xff51afd7ed558ccdull;
+    return (key ^ (key >> 33)) & (tableSize - 1);
+}
+
+// Returns where pointer's entry is or would go in the table.
+size_t findSlot(Snapshot *snapshot, void *pointer) {
+    size_t slot = hashPointer(pointer, snapshot->tableSize);
+    while (snapshot->keys[slot] != NULL && snapshot->keys[slot] != pointer) {
+        slot = (slot + 1) & (snapshot->tableSize - 1);
+    }
+    return slot;
+}
+
+void growTable(Snapshot *snapshot) {
+    void **oldKeys = snapshot->keys;
+    uint64_t *oldSlots = snapshot->slots;
+    size_t oldSize = snapshot->tableSize;
+    snapshot->tableSize = oldSize ? oldSize * 2 : 1024;
+    snapshot->keys = calloc(snapshot->tableSize, sizeof(void *));
+    snapshot->slots = malloc(snapshot->tableSize * sizeof(uint64_t));
+    for (size_t i = 0; i < oldSize; i++) {
+        if (oldKeys[i] != NULL) {
+            size_t slot = findSlot(snapshot, oldKeys[i]);
+            snapshot->keys[slot] = oldKeys[i];
+            snapshot->slots[slot] = oldSlots[i];
+        }
+    }
+    free(oldKeys);
+    free(oldSlots);
+}
+
+// Grows the array at *items so it can hold one more element of size bytes.
+void reserve(void **items, size_t count, size_t *capacity, size_t size) {
+    if (count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 1024;
+        *items = realloc(*items, *capacity * size);
+    }
+}
+
+// Records object if it hasn't been seen, queueing it to have its own
+// pointers followed.
+void visit(Snapshot *snapshot, void *object, int kind) {
+    if (object == NULL) {
+        return;
+    }
+    if (snapshot->used * 2 >= snapshot->tableSize) {
+        growTable(snapshot);
+    }
+    size_t slot = findSlot(snapshot, object);
+    if (snapshot->keys[slot] != NULL) {
+        return;
+    }
+    snapshot->keys[slot] = object;
+    snapshot->used++;
+    if (kind == VALUE_OBJECT) {
+        reserve((void **)&snapshot->values, snapshot->valueCount,
+                &snapshot->valueCapacity, sizeof(Value *));
+        snapshot->slots[slot] = snapshot->valueCount;
+        snapshot->values[snapshot->valueCount++] = object;
+    } else if (kind == FRAME_OBJECT) {
+        reserve((void **)&snapshot->frames, snapshot->frameCount,
+                &snapshot->frameCapacity, sizeof(Frame *));
+        snapshot->slots[slot] = snapshot->frameCount;
+        snapshot->frames[snapshot->frameCount++] = object;
+    } else {
+        //strings are only copied, so their slot is their offset within the
+        //string area
+        reserve((void **)&snapshot->strings, snapshot->stringCount,
+                &snapshot->stringCapacity, sizeof(char *));
+        snapshot->slots[slot] = snapshot->stringBytes;
+        snapshot->strings[snapshot->stringCount++] = object;
+        snapshot->stringBytes += strlen(object) + 1;
+        return;
+    }
+    reserve((void **)&snapshot->pending, snapshot->pendingCount,
+            &snapshot->pendingCapacity, sizeof(PendingObject));
+    snapshot->pending[snapshot->pendingCount].object = object;
+    snapshot->pending[snapshot->pendingCount++].kind = kind;
+}
+
+// Visits everything reachable from frame and macros, without recursion so
+// that long lists and deep frame chains can't overflow the stack.
+void collect(Snapshot *snapshot, Frame *frame, Value *macros, char *path) {
+    visit(snapshot, frame, FRAME_OBJECT);
+    visit(snapshot, macros, VALUE_OBJECT);
+    while (snapshot->pendingCount > 0) {
+        PendingObject next = snapshot->pending[--snapshot->pendingCount];
+        void *object = next.object;
+        if (next.kind == FRAME_OBJECT) {
+            Frame *current = object;
+            visit(snapshot, current->bindings, VALUE_OBJECT);
+            visit(snapshot, current->parent, FRAME_OBJECT);
+            continue;
+        }
+        Value *item = object;
+        switch (item->type) {
+            case CONS_TYPE:
+                visit(snapshot, item->c.car, VALUE_OBJECT);
+                visit(snapshot, item->c.cdr, VALUE_OBJECT);
+                break;
+            case PROMISE_TYPE:
+                visit(snapshot, item->promise.content, VALUE_OBJECT);
+                break;
+            case CLOSURE_TYPE:
+                visit(snapshot, item->closure.paramNames, VALUE_OBJECT);
+                visit(snapshot, item->closure.fnBody, VALUE_OBJECT);
+                visit(snapshot, item->closure.frame, FRAME_OBJECT);
+                break;
+            case STR_TYPE:
+            case SYMBOL_TYPE:
+            case OPEN_TYPE:
+            case CLOSE_TYPE:
+            case OPENBRACKET_TYPE:
+            case CLOSEBRACKET_TYPE:
+            case DOT_TYPE:
+            case SINGLEQUOTE_TYPE:
+                visit(snapshot, item->s, STRING_OBJECT);
+                break;
+            case PRIMITIVE_TYPE:
+                if (primitiveIndex(item->primFn) < 0) {
+                    imageError("unknown primitive function in heap", path);
+                }
+                break;
+            case PTR_TYPE:
+                imageError("raw pointer in heap can't be saved", path);
+                break;
+            case FUTURE_TYPE:
+                imageError("futures can't be saved", path);
+                break;
+            case CHANNEL_TYPE:
+                imageError("channels can't be saved", path);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+uint64_t valueOffset(Snapshot *snapshot, uint64_t valuesOffset, Value *item) {
+    if (item == NULL) {
+        return 0;
+    }
+    return valuesOffset +
+        snapshot->slots[findSlot(snapshot, item)] * sizeof(Value);
+}
+
+uint64_t frameOffset(Snapshot *snapshot, uint64_t framesOffset, Frame *frame) {
+    if (frame == NULL) {
+        return 0;
+    }
+    return framesOffset +
+        snapshot->slots[findSlot(snapshot, frame)] * sizeof(Frame);
+}
+
+void saveImage(char *path, Frame *frame) {
+    Snapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    Value *macros = macroDefinitions();
+    collect(&snapshot, frame, macros, path);
+
+    ImageHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = IMAGE_MAGIC;
+    header.version = IMAGE_VERSION;
+    header.valueSize = sizeof(Value);
+    header.frameSize = sizeof(Frame);
+    header.valueCount = snapshot.valueCount;
+    header.frameCount = snapshot.frameCount;
+    header.valuesOffset = sizeof(ImageHeader);
+    header.framesOffset = header.valuesOffset + snapshot.valueCount * sizeof(Value);
+    header.stringsOffset = header.framesOffset + snapshot.frameCount * sizeof(Frame);
+    header.fileSize = header.stringsOffset + snapshot.stringBytes;
+    header.topFrame = frameOffset(&snapshot, header.framesOffset, frame);
+    header.macros = valueOffset(&snapshot, header.valuesOffset, macros);
+    header.macroRenames = currentInterpreter()->macros.renames;
+
+    char *image = calloc(1, header.fileSize);
+    memcpy(image, &header, sizeof(header));
+    Value *values = (Value *)(image + header.valuesOffset);
+    for (size_t i = 0; i < snapshot.valueCount; i++) {
+        Value *item = snapshot.values[i];
+        Value *copy = &values[i];
+        *copy = *item;
+        switch (item->type) {
+            case CONS_TYPE:
+                copy->c.car = (Value *)(uintptr_t)
+                    valueOffset(&snapshot, header.valuesOffset, item->c.car);
+                copy->c.cdr = (Value *)(uintptr_t)
+                    valueOffset(&snapshot, header.valuesOffset, item->c.cdr);
+                break;
+            case PROMISE_TYPE:
+                copy->promise.content = (Value *)(uintptr_t)valueOffset(
+                    &snapshot, header.valuesOffset, item->promise.content);
+                break;
+            case CLOSURE_TYPE:
+                copy->closure.paramNames = (Value *)(uintptr_t)valueOffset(
+                    &snapshot, header.valuesOffset, item->closure.paramNames);
+                copy->closure.fnBody = (Value *)(uintptr_t)valueOffset(
+                    &snapshot, header.valuesOffset, item->closure.fnBody);
+                copy->closure.frame = (Frame *)(uintptr_t)frameOffset(
+                    &snapshot, header.framesOffset, item->closure.frame);
+                break;
+            case STR_TYPE:
+            case SYMBOL_TYPE:
+            case OPEN_TYPE:
+            case CLOSE_TYPE:
+            case OPENBRACKET_TYPE:
+            case CLOSEBRACKET_TYPE:
+            case DOT_TYPE:
+            case SINGLEQUOTE_TYPE:
+                copy->s = (char *)(uintptr_t)(header.stringsOffset +
+                    snapshot.slots[findSlot(&snapshot, item->s)]);
+                break;
+            case PRIMITIVE_TYPE:
+                copy->p = (void *)(uintptr_t)primitiveIndex(item->primFn);
+                break;
+            default:
+                break;
+        }
+    }
+    Frame *frames = (Frame *)(image + header.framesOffset);
+    for (size_t i = 0; i < snapshot.frameCount; i++) {
+        Frame *current = snapshot.frames[i];
+        frames[i].bindings = (Value *)(uintptr_t)
+            valueOffset(&snapshot, header.valuesOffset, current->bindings);
+        frames[i].parent = (Frame *)(uintptr_t)
+            frameOffset(&snapshot, header.framesOffset, current->parent);
+        frames[i].code = NULL;
+    }
+    for (size_t i = 0; i < snapshot.stringCount; i++) {
+        char *string = snapshot.strings[i];
+        strcpy(image + header.stringsOffset +
+               snapshot.slots[findSlot(&snapshot, string)], string);
+    }
+
+    free(snapshot.keys);
+    free(snapshot.slots);
+    free(snapshot.values);
+    free(snapshot.frames);
+    free(snapshot.strings);
+    free(snapshot.pending);
+
+    char temporary[4200];
+    snprintf(temporary, sizeof(temporary), "%s.%d", path, (int)getpid());
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(image);
+        imageError("could not create image", path);
+    }
+    size_t written = 0;
+    while (written < header.fileSize) {
+        ssize_t result = write(fd, image + written, header.fileSize - written);
+        if (result <= 0) {
+            break;
+        }
+        written += result;
+    }
+    close(fd);
+    free(image);
+    if (written != header.fileSize || rename(temporary, path) < 0) {
+        unlink(temporary);
+        imageError("could not write image", path);
+    }
+}
+
+/* Loading */
+
+// Turns a stored offset back into a pointer, checking that it lands on an
+// object of the right kind.
+void *relocate(char *base, ImageHeader *header, void *stored, int kind) {
+    uint64_t offset = (uint64_t)(uintptr_t)stored;
+    if (offset == 0) {
+        return NULL;
+    }
+    int valid;
+    if (kind == VALUE_OBJECT) {
+        valid = offset >= header->valuesOffset && offset < header->framesOffset &&
+            (offset - header->valuesOffset) % sizeof(Value) == 0;
+    } else if (kind == FRAME_OBJECT) {
+        valid = offset >= header->framesOffset && offset < header->stringsOffset &&
+            (offset - header->framesOffset) % sizeof(Frame) == 0;
+    } else {
+        valid = offset >= header->stringsOffset && offset < header->fileSize;
+    }
+    return valid ? base + offset : NULL;
+}
+
+Frame *loadImage(char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        imageError("could not open image", path);
+    }
+    struct stat info;
+    ImageHeader header;
+    if (fstat(fd, &info) < 0 ||
+        read(fd, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != IMAGE_MAGIC || header.version != IMAGE_VERSION ||
+        header.valueSize != sizeof(Value) || header.frameSize != sizeof(Frame) ||
+        header.fileSize != (uint64_t)info.st_size ||
+        header.valuesOffset != sizeof(ImageHeader) ||
+        header.framesOffset != header.valuesOffset +
+            header.valueCount * sizeof(Value) ||
+        header.stringsOffset != header.framesOffset +
+            header.frameCount * sizeof(Frame) ||
+        header.stringsOffset > header.fileSize) {
+        close(fd);
+        imageError("not an image for this interpreter", path);
+    }
+    //a private writable mapping: pages are only copied once written, which
+    //relocation does to the values and frames but not to the strings
+    char *base = mmap(NULL, header.fileSize, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        imageError("could not map image", path);
+    }
+    if (header.fileSize > header.stringsOffset &&
+        base[header.fileSize - 1] != '\0') {
+        imageError("corrupt image", path);
+    }
+
+    int corrupt = 0;
+    Value *values = (Value *)(base + header.valuesOffset);
+    for (uint64_t i = 0; i < header.valueCount; i++) {
+        Value *item = &values[i];
+        switch (item->type) {
+            case CONS_TYPE:
+                item->c.car = relocate(base, &header, item->c.car, VALUE_OBJECT);
+                item->c.cdr = relocate(base, &header, item->c.cdr, VALUE_OBJECT);
+                corrupt |= item->c.car == NULL || item->c.cdr == NULL;
+                break;
+            case PROMISE_TYPE:
+                item->promise.content = relocate(base, &header,
+                    item->promise.content, VALUE_OBJECT);
+                corrupt |= item->promise.content == NULL ||
+                    item->promise.state > PROMISE_FORWARDED;
+                break;
+            case CLOSURE_TYPE:
+                item->closure.paramNames = relocate(base, &header,
+                    item->closure.paramNames, VALUE_OBJECT);
+                item->closure.fnBody = relocate(base, &header,
+                    item->closure.fnBody, VALUE_OBJECT);
+                item->closure.frame = relocate(base, &header,
+                    item->closure.frame, FRAME_OBJECT);
+                corrupt |= item->closure.paramNames == NULL ||
+                    item->closure.fnBody == NULL;
+                break;
+            case STR_TYPE:
+            case SYMBOL_TYPE:
+            case OPEN_TYPE:
+            case CLOSE_TYPE:
+            case OPENBRACKET_TYPE:
+            case CLOSEBRACKET_TYPE:
+            case DOT_TYPE:
+            case SINGLEQUOTE_TYPE:
+                item->s = relocate(base, &header, item->s, STRING_OBJECT);
+                corrupt |= item->s == NULL;
+                break;
+            case PRIMITIVE_TYPE:
+                item->primFn = primitiveAt((int)(uintptr_t)item->p);
+                corrupt |= item->primFn == NULL;
+                break;
+            default:
+                break;
+        }
+    }
+    Frame *frames = (Frame *)(base + header.framesOffset);
+    for (uint64_t i = 0; i < header.frameCount; i++) {
+        frames[i].bindings = relocate(base, &header, frames[i].bindings,
+                                      VALUE_OBJECT);
+        frames[i].parent = relocate(base, &header, frames[i].parent,
+                                    FRAME_OBJECT);
+        //the code isn't saved, so a define could be anywhere
+        frames[i].code = NULL;
+        corrupt |= frames[i].bindings == NULL;
+    }
+    Frame *top = relocate(base, &header, (void *)(uintptr_t)header.topFrame,
+                          FRAME_OBJECT);
+    Value *macros = relocate(base, &header, (void *)(uintptr_t)header.macros,
+                             VALUE_OBJECT);
+    if (corrupt || top == NULL || macros == NULL) {
+        imageError("corrupt image", path);
+    }
+    setGlobalFrame(top);
+    defineMacros(macros);
+    currentInterpreter()->macros.renames = header.macroRenames;
+    return top;
+}
@@ -0,0 +1,21 @@
+#include "value.h"
+
+#ifndef _IMAGE
+#define _IMAGE
+
+// Heap images: a snapshot of everything reachable from the global frame
+// (bindings, closures, the frames they captured, quoted data and strings)
+// and of the macros define-syntax has made, so that a later run can start
+// from an evaluated prelude instead of evaluating it again. An image is only
+// valid for the build that wrote it.
+
+// Writes everything reachable from frame, and the macro table, to an image
+// file at path. Exits with an error if the file can't be written.
+void saveImage(char *path, Frame *frame);
+
+// Maps the image at path into memory, fixes up its pointers and primitive
+// functions, and returns the frame it was saved from. Exits with an error if
+// the file isn't a usable image.
+Frame *loadImage(char *path);
+
+#endif
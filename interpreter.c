@@ -3,63 +3,228 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "value.h"
 #include "interpreter.h"
 #include "parser.h"
 #include "tokenizer.h"
 #include "linkedlist.h"
 #include "talloc.h"
+#include "output.h"
+#include "formcache.h"
+#include "future.h"
+#include "fiber.h"
+#include "lists.h"
+#include "macro.h"
+#include "promise.h"
+#include "stack.h"
+#include "profiler.h"
+#include "metrics.h"
 
 void printValue(Value *item);
 
+/*
+* A file read by load, with the details from stat used to tell whether
+* it has changed since its forms were parsed.
+*/
+typedef struct LoadedFile {
+    char *path;
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    Value *forms;
+    struct LoadedFile *next;
+} LoadedFile;
+
+// The instance the calling thread is running. A future worker has one only
+// while it runs a task, that of the instance that submitted it.
+_Thread_local Interpreter *interpreter = NULL;
+
+Interpreter *currentInterpreter() {
+    if (interpreter == NULL) {
+        evalError("no interpreter instance");
+    }
+    return interpreter;
+}
+
+Interpreter *borrowInterpreter(Interpreter *interp) {
+    Interpreter *previous = interpreter;
+    interpreter = interp;
+    return previous;
+}
+
 void evalError(char* errorMessage) {
-    printf("%s: %s", "Evaluation error", errorMessage);
-    texit(1);
+    outString("Evaluation error: ");
+    outString(errorMessage);
+    outFlush();
+    abandonEvaluation();
+}
+
+/*
+* Adds cell to the growable array of the cells whose car is a list being
+* printed, so printing nested lists needs no recursion.
+*/
+Value **pushOpenList(Value **open, int *count, int *capacity, Value *cell) {
+    if (*count == *capacity) {
+        *capacity = *capacity == 0 ? 16 : *capacity * 2;
+        open = realloc(open, *capacity * sizeof(Value *));
+    }
+    open[(*count)++] = cell;
+    return open;
 }
 
 void printList(Value *tree) {
-    printf("(");
-    while (tree->type != NULL_TYPE) {
+    Value **open = NULL;
+    int depth = 0;
+    int capacity = 0;
+    outChar('(');
+    while (1) {
         if (car(tree)->type == CONS_TYPE) {
-            printList(car(tree));
-        } else {
-            printValue(car(tree));
-            if (cdr(tree)->type != CONS_TYPE && 
-                cdr(tree)->type != NULL_TYPE) {
-                printf(" . ");
-                printValue(cdr(tree));
-                break;
+            open = pushOpenList(open, &depth, &capacity, tree);
+            outChar('(');
+            tree = car(tree);
+            continue;
+        }
+        printValue(car(tree));
+        //close this list and every enclosing one it ends
+        Value *next = cdr(tree);
+        while (next->type != CONS_TYPE) {
+            if (next->type != NULL_TYPE) {
+                outString(" . ");
+                printValue(next);
             }
+            outString(") ");
+            if (depth == 0) {
+                free(open);
+                return;
+            }
+            next = cdr(open[--depth]);
         }
         //add whitespace if not last token in expression
-        if (cdr(tree)->type != NULL_TYPE) {
-            printf(" ");
-        }
-        Value *next = cdr(tree);
+        outChar(' ');
         tree = next;
     }
-    printf(") ");
 }
 
 void printValue(Value *item) {
     if (item->type == BOOL_TYPE) {
         if (item->i == 0) {
-            printf("#f\n");
+            outString("#f\n");
         } else {
-            printf("#t\n");
+            outString("#t\n");
         }
     } else if (item->type == INT_TYPE) {
-        printf("%i\n", item->i);
+        outInt(item->i);
+        outChar('\n');
     } else if (item->type == DOUBLE_TYPE) {
-        printf("%f\n", item->d);
+        outDouble(item->d);
+        outChar('\n');
     } else if (item->type == STR_TYPE || item->type == SYMBOL_TYPE) {
-        printf("%s\n", item->s);
+        outString(item->s);
+        outChar('\n');
     } else if (item->type == CONS_TYPE) {
         printList(item);
     } else if (item->type == NULL_TYPE) {
-        printf("()\n");
+        outString("()\n");
     } else if (item->type == CLOSURE_TYPE) {
-        printf("#<procedure>\n");
+        outString("#<procedure>\n");
+    } else if (item->type == FUTURE_TYPE) {
+        outString("#<future>\n");
+    } else if (item->type == CHANNEL_TYPE) {
+        outString("#<channel>\n");
+    } else if (item->type == PROMISE_TYPE) {
+        outString("#<promise>\n");
+    }
+}
+
+void writeDatum(Value *item, int forDisplay);
+
+// Writes the list for writeDatum, keeping the lists it is inside of on the
+// heap rather than recursing into them.
+void writeList(Value *list, int forDisplay) {
+    Value **open = NULL;
+    int depth = 0;
+    int capacity = 0;
+    outChar('(');
+    while (1) {
+        if (car(list)->type == CONS_TYPE) {
+            open = pushOpenList(open, &depth, &capacity, list);
+            outChar('(');
+            list = car(list);
+            continue;
+        }
+        writeDatum(car(list), forDisplay);
+        Value *next = cdr(list);
+        while (next->type != CONS_TYPE) {
+            if (next->type != NULL_TYPE) {
+                outString(" . ");
+                writeDatum(next, forDisplay);
+            }
+            outChar(')');
+            if (depth == 0) {
+                free(open);
+                return;
+            }
+            next = cdr(open[--depth]);
+        }
+        outChar(' ');
+        list = next;
+    }
+}
+
+/*
+* Writes a value the way display (forDisplay set) or write show it:
+* lists on one line with single spaces, strings with their quotes only
+* for write, and doubles in their shortest form.
+*/
+void writeDatum(Value *item, int forDisplay) {
+    switch (item->type) {
+        case INT_TYPE:
+            outInt(item->i);
+            break;
+        case DOUBLE_TYPE:
+            outDoubleShortest(item->d);
+            break;
+        case STR_TYPE:
+            if (forDisplay) {
+                //strings keep their quotes from the tokenizer
+                outBytes(item->s + 1, strlen(item->s) - 2);
+            } else {
+                outString(item->s);
+            }
+            break;
+        case SYMBOL_TYPE:
+            outString(item->s);
+            break;
+        case BOOL_TYPE:
+            outString(item->i ? "#t" : "#f");
+            break;
+        case NULL_TYPE:
+            outString("()");
+            break;
+        case CONS_TYPE:
+            writeList(item, forDisplay);
+            break;
+        case CLOSURE_TYPE:
+        case PRIMITIVE_TYPE:
+            outString("#<procedure>");
+            break;
+        case FUTURE_TYPE:
+            outString("#<future>");
+            break;
+        case CHANNEL_TYPE:
+            outString("#<channel>");
+            break;
+        case PROMISE_TYPE:
+            outString("#<promise>");
+            break;
+        default:
+            break;
     }
 }
 
@@ -72,11 +237,12 @@ void printValue(Value *item) {
 void bindFn(char *name, Value *(*function)(Value *), Frame *frame) {
 	Value *funcName = makeNull();
 	funcName->type = SYMBOL_TYPE;
-	funcName->s = name;
+	funcName->s = internSymbol(name, strlen(name));
     Value *primitiveFunction = makeNull();
     primitiveFunction->type = PRIMITIVE_TYPE;
     primitiveFunction->primFn = function;
     Value *binding = cons(funcName, primitiveFunction);
+    REGISTER_PRIMITIVE(name, function);
 	Value *temp = cons(binding, frame->bindings);
 	frame->bindings = temp;
     return;
@@ -302,48 +468,369 @@ Value *primitiveLess(Value *args){
 	return boolean;
 }
 
+Value *primitiveDisplay(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for display");
+    }
+    writeDatum(car(args), 1);
+    Value *voidVal = makeNull();
+    voidVal->type = VOID_TYPE;
+    return voidVal;
+}
+
+Value *primitiveWrite(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for write");
+    }
+    writeDatum(car(args), 0);
+    Value *voidVal = makeNull();
+    voidVal->type = VOID_TYPE;
+    return voidVal;
+}
+
+Value *primitiveNewline(Value *args) {
+    if (length(args) != 0) {
+        evalError("wrong number of args for newline");
+    }
+    outChar('\n');
+    Value *voidVal = makeNull();
+    voidVal->type = VOID_TYPE;
+    return voidVal;
+}
+
+Value *primitiveLoad(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for load");
+    } else if (car(args)->type != STR_TYPE) {
+        evalError("load expects a file name string");
+    }
+    //strip the quotes the tokenizer keeps on strings
+    char *quoted = car(args)->s;
+    size_t nameLength = strlen(quoted) - 2;
+    char *path = talloc(nameLength + 1);
+    memcpy(path, quoted + 1, nameLength);
+    path[nameLength] = '\0';
+    loadFile(path, currentInterpreter()->globalFrame, 0);
+    Value *voidVal = makeNull();
+    voidVal->type = VOID_TYPE;
+    return voidVal;
+}
+
+/*
+* Every primitive function and the name it is bound to, in the order
+* they are bound. Images refer to primitives by their position here, so
+* new primitives go at the end.
+*/
+typedef struct Primitive {
+    char *name;
+    Value *(*function)(Value *);
+} Primitive;
+
+Primitive primitives[] = {
+    {"+", primitiveAdd},
+    {"car", primitiveCar},
+    {"cdr", primitiveCdr},
+    {"cons", primitiveCons},
+    {"null?", primitiveNull},
+    {"=", primitiveEqual},
+    {"<", primitiveLess},
+    {">", primitiveGreater},
+    {"-", primitiveSubtract},
+    {"*", primitiveMultiply},
+    {"/", primitiveDivide},
+    {"modulo", primitiveMod},
+    {"display", primitiveDisplay},
+    {"write", primitiveWrite},
+    {"newline", primitiveNewline},
+    {"load", primitiveLoad},
+    {"future", primitiveFuture},
+    {"touch", primitiveTouch},
+    {"pmap", primitivePmap},
+    {"spawn", primitiveSpawn},
+    {"yield", primitiveYield},
+    {"make-channel", primitiveMakeChannel},
+    {"channel-send", primitiveChannelSend},
+    {"channel-recv", primitiveChannelRecv},
+    {"list", primitiveList},
+    {"length", primitiveLength},
+    {"append", primitiveAppend},
+    {"reverse", primitiveReverse},
+    {"list-tail", primitiveListTail},
+    {"list-ref", primitiveListRef},
+    {"member", primitiveMember},
+    {"assoc", primitiveAssoc},
+    {"map", primitiveMap},
+    {"for-each", primitiveForEach},
+    {"filter", primitiveFilter},
+    {"fold-left", primitiveFoldLeft},
+    {"fold-right", primitiveFoldRight},
+    {"apply", primitiveApply},
+    {"force", primitiveForce},
+    {"make-promise", primitiveMakePromise},
+    {"promise?", primitivePromiseP},
+    {"stream-car", primitiveStreamCar},
+    {"stream-cdr", primitiveStreamCdr},
+};
+
+#define PRIMITIVE_COUNT ((int)(sizeof(primitives) / sizeof(primitives[0])))
+
+/*
+* Returns the position of function in the primitive table, or -1 if it
+* isn't a primitive.
+*/
+int primitiveIndex(Value *(*function)(Value *)) {
+    for (int i = 0; i < PRIMITIVE_COUNT; i++) {
+        if (primitives[i].function == function) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+* Returns the primitive function at position index in the primitive
+* table, or NULL if there is none.
+*/
+Value *(*primitiveAt(int index))(Value *) {
+    if (index < 0 || index >= PRIMITIVE_COUNT) {
+        return NULL;
+    }
+    return primitives[index].function;
+}
+
 void bindPrimitives(Frame *frame) {
-    bindFn("+", primitiveAdd, frame);
-	bindFn("car", primitiveCar, frame);
-	bindFn("cdr", primitiveCdr, frame);
-	bindFn("cons", primitiveCons, frame);
-    bindFn("null?", primitiveNull, frame);
-	bindFn("=", primitiveEqual, frame);
-    bindFn("<", primitiveLess, frame);
-	bindFn(">", primitiveGreater, frame);
-	bindFn("-", primitiveSubtract, frame);
-	bindFn("*", primitiveMultiply, frame);
-    bindFn("/", primitiveDivide, frame);
-    bindFn("modulo", primitiveMod, frame);
+    for (int i = 0; i < PRIMITIVE_COUNT; i++) {
+        bindFn(primitives[i].name, primitives[i].function, frame);
+    }
     return;
 }
 
 /*
-* Interprets each top level S-expression in the tree
-* and prints out the results.
+* Makes frame the top-level frame that load evaluates into, for a
+* global frame that didn't come from makeGlobalFrame.
 */
-void interpret(Value *tree) {
+void setGlobalFrame(Frame *frame) {
+    currentInterpreter()->globalFrame = frame;
+}
+
+/*
+* Creates the top-level frame with all primitive functions bound.
+*/
+Frame *makeGlobalFrame() {
     Frame *globalFrame = talloc(sizeof(Frame));
     globalFrame->bindings = makeNull();
     globalFrame->parent = NULL;
+    globalFrame->code = NULL;
 	bindPrimitives(globalFrame);
+    if (interpreter != NULL) {
+        interpreter->globalFrame = globalFrame;
+    }
+    return globalFrame;
+}
+
+void useInterpreter(Interpreter *interp) {
+    interpreter = interp;
+    useAllocator(interp != NULL ? &interp->allocator : NULL);
+    useSymbolTable(interp != NULL ? &interp->symbols : NULL);
+}
+
+Interpreter *newInterpreter() {
+    Interpreter *interp = malloc(sizeof(Interpreter));
+    if (interp == NULL) {
+        evalError("out of memory");
+    }
+    memset(interp, 0, sizeof(Interpreter));
+    initFormTable(&interp->freeVariables);
+    initFormTable(&interp->definingCode);
+    initNodeTable(&interp->nodes);
+    useInterpreter(interp);
+    makeGlobalFrame();
+    return interp;
+}
+
+void freeInterpreter(Interpreter *interp) {
+    Interpreter *previous = interpreter;
+    useInterpreter(interp);
+    tfree();
+    useInterpreter(previous == interp ? NULL : previous);
+    freeFormTable(&interp->freeVariables);
+    freeFormTable(&interp->definingCode);
+    freeNodeTable(&interp->nodes);
+    free(interp);
+}
+
+/*
+* Expands the macros in a single top-level expression, then evaluates
+* it in the given frame and prints the result. Output is buffered; it is flushed before the
+* tokenizer waits for more input, so results still appear as soon as
+* each form is evaluated.
+*/
+void interpretExpr(Value *expr, Frame *frame) {
+    printValue(eval(expandMacros(expr), frame));
+    settleFibers();
+}
+
+/*
+* Interprets each top level S-expression in the tree in the given
+* frame and prints out the results.
+*/
+void interpretInFrame(Value *tree, Frame *frame) {
     while (tree->type != NULL_TYPE) {
-        Value *expr = car(tree);
-        printValue(eval(expr, globalFrame));
+        interpretExpr(car(tree), frame);
         Value *next = cdr(tree);
         tree = next;
     }
 }
 
+/*
+* Maps the file at path into memory and reads all of its top-level
+* forms, returning them as a list, or NULL if the file can't be read.
+* Forms are taken from the binary form cache when it has this exact
+* source; otherwise they are parsed and the cache is written. The
+* tokenizer's current input is put back afterwards.
+*/
+Value *readFileForms(char *path, struct stat *info) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, info) < 0) {
+        close(fd);
+        return NULL;
+    }
+    Value *forms = makeNull();
+    if (info->st_size == 0) {
+        close(fd);
+        return forms;
+    }
+    char *contents = mmap(NULL, info->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (contents == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(contents, info->st_size, MADV_SEQUENTIAL);
+    uint64_t hash = hashSource(contents, info->st_size);
+    //cached forms have no source lines for the profiler
+    forms = profilerRunning ? NULL : readFormCache(hash, info->st_size);
+    if (forms != NULL) {
+        munmap(contents, info->st_size);
+        return forms;
+    }
+    setSourceName(path);
+    forms = readForms(contents, info->st_size);
+    setSourceName("stdin");
+    //symbols and strings are copied out by the tokenizer, so the mapping
+    //is no longer needed
+    munmap(contents, info->st_size);
+    writeFormCache(hash, info->st_size, forms);
+    return forms;
+}
+
+/*
+* Returns the top-level forms of the file at path, parsing it only if it
+* hasn't been loaded before or has changed since it was.
+*/
+Value *fileForms(char *path) {
+    struct stat info;
+    if (stat(path, &info) < 0) {
+        evalError("could not open file to load");
+    }
+    Interpreter *interp = currentInterpreter();
+    LoadedFile *file = interp->loadedFiles;
+    while (file != NULL) {
+        if (file->device == info.st_dev && file->inode == info.st_ino) {
+            if (file->size == info.st_size &&
+                file->modified.tv_sec == info.st_mtim.tv_sec &&
+                file->modified.tv_nsec == info.st_mtim.tv_nsec) {
+                return file->forms;
+            }
+            break;
+        }
+        file = file->next;
+    }
+    Value *forms = readFileForms(path, &info);
+    if (forms == NULL) {
+        evalError("could not open file to load");
+    }
+    if (file == NULL) {
+        file = talloc(sizeof(LoadedFile));
+        file->next = interp->loadedFiles;
+        interp->loadedFiles = file;
+    }
+    file->path = path;
+    file->device = info.st_dev;
+    file->inode = info.st_ino;
+    file->size = info.st_size;
+    file->modified = info.st_mtim;
+    file->forms = forms;
+    return forms;
+}
+
+/*
+* Evaluates each top-level form of the file at path in the given frame,
+* printing the results if printResults is set.
+*/
+void loadFile(char *path, Frame *frame, int printResults) {
+    Value *forms = fileForms(path);
+    while (forms->type != NULL_TYPE) {
+        //the parsed forms are kept for the next load, so they're expanded
+        //into new ones each time rather than changed
+        Value *result = eval(expandMacros(car(forms)), frame);
+        if (printResults) {
+            printValue(result);
+        }
+        settleFibers();
+        forms = cdr(forms);
+    }
+}
+
+int interpretString(Interpreter *interp, const char *text, size_t length) {
+    Interpreter *previous = interpreter;
+    useInterpreter(interp);
+    InputSource saved = saveInput();
+    EvalStack stack = evalStack;
+    jmp_buf *outer = errorExit;
+    jmp_buf handler;
+    int status = 0;
+    if (setjmp(handler) == 0) {
+        errorExit = &handler;
+        setInputBuffer(text, length);
+        Value *expr = readDatum();
+        while (expr != NULL) {
+            interpretExpr(expr, interp->globalFrame);
+            expr = readDatum();
+        }
+    } else {
+        //back here from evalError, perhaps off a task's or segment's stack
+        evalStack = stack;
+        abandonFibers();
+        status = 1;
+    }
+    errorExit = outer;
+    restoreInput(saved);
+    useInterpreter(previous);
+    return status;
+}
+
+/*
+* Interprets each top level S-expression in the tree
+* and prints out the results.
+*/
+void interpret(Value *tree) {
+    interpretInFrame(tree, makeGlobalFrame());
+}
+
 /* 
 * Bindings are cons cells with the car as the variable and the 
 * cdr as the value. Returns the value of a bound variable, if        * applicable. 
 */
 Value *getBoundValue(char *symbol, Frame *frame) {
+    COUNT_LOOKUP();
     while (frame != NULL) {
         Value *binding = frame->bindings;
         while (binding->type != NULL_TYPE) {
-            if (!strcmp(car(car(binding))->s, symbol)) {
+            COUNT_LOOKUP_STEP();
+            if (sameName(car(car(binding))->s, symbol)) {
                 //binding found
                 return cdr(car(binding));
             } else {
@@ -383,7 +870,7 @@ int contains(Value *list, Value* item) {
         }
         if (cur->type == item->type) {
             if (cur->type == STR_TYPE || cur->type == SYMBOL_TYPE) {
-                if (!strcmp(cur->s, item->s)) {
+                if (sameName(cur->s, item->s)) {
                     return 1;
                 }
             } else if (cur->type == INT_TYPE 
@@ -434,7 +921,11 @@ Value *evalLetBody(Value *letBody, Frame *letFrame) {
     }
 }
 
-Value *evalLet(Value *letArgs, Frame *frame) {
+/*
+* Creates the frame for a let with the given arguments and binds its
+* variables, each evaluated in frame.
+*/
+Frame *makeLetFrame(Value *letArgs, Frame *frame) {
     Value *bindingList;
     if (letArgs->type == CONS_TYPE) {
         bindingList = car(letArgs);
@@ -446,23 +937,37 @@ Value *evalLet(Value *letArgs, Frame *frame) {
     }
     //create new frame to hold let bindings
     Frame *letFrame = talloc(sizeof(Frame));
+    COUNT_FRAME();
     letFrame->parent = frame;
     letFrame->bindings = makeNull();
+    letFrame->code = letArgs;
     //set bindings
     while (bindingList->type != NULL_TYPE) {
 		bindLetArg(bindingList, frame, letFrame);
         bindingList = cdr(bindingList);
     }
+    return letFrame;
+}
+
+Value *evalNamedLet(Value *letArgs, Frame *frame);
+
+Value *evalLet(Value *letArgs, Frame *frame) {
+    if (letArgs->type == CONS_TYPE && car(letArgs)->type == SYMBOL_TYPE) {
+        return evalNamedLet(letArgs, frame);
+    }
+    Frame *letFrame = makeLetFrame(letArgs, frame);
     Value *letBody = cdr(letArgs);
     return evalLetBody(letBody, letFrame);
 }
 
-Value *evalLetStar(Value *args, Frame *frame) {
+/*
+* Creates the chain of frames for a let* with the given arguments,
+* one per variable, and returns the innermost.
+*/
+Frame *makeLetStarFrame(Value *args, Frame *frame) {
 	Value *bindingList = makeNull();
-    Value *letBody = makeNull();
     if (args->type == CONS_TYPE) {
         bindingList = car(args);
-        letBody = cdr(args);
     }
     if (bindingList->type != CONS_TYPE && bindingList->type != NULL_TYPE) {
         evalError("improper variable binding format in let*");
@@ -470,14 +975,23 @@ Value *evalLetStar(Value *args, Frame *frame) {
     Frame *parentFrame = frame;
 	while (bindingList->type != NULL_TYPE) {
         Frame *letStarFrame = talloc(sizeof(Frame));
+        COUNT_FRAME();
         letStarFrame->parent = parentFrame;
         letStarFrame->bindings = makeNull();
+        letStarFrame->code = args;
 		bindLetArg(bindingList, parentFrame, letStarFrame);
         bindingList = cdr(bindingList);
         parentFrame = letStarFrame;
 	}
-    return evalLetBody(letBody, parentFrame);
-	
+    return parentFrame;
+}
+
+Value *evalLetStar(Value *args, Frame *frame) {
+    Value *letBody = makeNull();
+    if (args->type == CONS_TYPE) {
+        letBody = cdr(args);
+    }
+    return evalLetBody(letBody, makeLetStarFrame(args, frame));
 }
 
 Value *evalLetrec(Value *args, Frame *frame) {
@@ -492,13 +1006,16 @@ Value *evalLetrec(Value *args, Frame *frame) {
     }
     
 	Frame *letFrame = talloc(sizeof(Frame));
+    COUNT_FRAME();
     letFrame->parent = frame;
     letFrame->bindings = makeNull();
+    letFrame->code = args;
 
-	Value *variableList = makeNull();
-	Value *expressionList = makeNull();
-	while(bindingList->type != NULL_TYPE){
-		Value *binding = car(bindingList);
+	//bind every variable before evaluating anything, so that closures
+	//made by the expressions capture the cells their values will go in
+	Value *cellList = makeNull();
+	for (Value *list = bindingList; list->type != NULL_TYPE; list = cdr(list)) {
+		Value *binding = car(list);
 		if (binding->type != CONS_TYPE) {
         	evalError("improper variable binding format in letrec");
     	} else if (length(binding) != 2) {
@@ -510,24 +1027,411 @@ Value *evalLetrec(Value *args, Frame *frame) {
 		} else if (contains(letFrame->bindings, variable)) {
 			evalError("duplicate bound variable in letrec");
 		}
-		Value *temp1 = cons(variable, variableList);
-		variableList = temp1;
-		Value *expression = eval(car(cdr(binding)), letFrame);
+		Value *unassigned = makeNull();
+		unassigned->type = VOID_TYPE;
+		Value *newBinding = cons(variable, unassigned);
+		letFrame->bindings = cons(newBinding, letFrame->bindings);
+		cellList = cons(newBinding, cellList);
+	}
+	Value *expressionList = makeNull();
+	while(bindingList->type != NULL_TYPE){
+		Value *expression = eval(car(cdr(car(bindingList))), letFrame);
 		Value *temp2 = cons(expression, expressionList);
 		expressionList = temp2;
 		bindingList = cdr(bindingList);
 	}
-	//bind each variable to its evaluated expression
-	while(variableList->type != NULL_TYPE){
-		Value *newBinding = cons(car(variableList), car(expressionList));
-    	Value *temp = cons(newBinding, letFrame->bindings);
-    	letFrame->bindings = temp;
-		variableList = cdr(variableList);
+	//assign each variable its evaluated expression
+	while(cellList->type != NULL_TYPE){
+		car(cellList)->c.cdr = car(expressionList);
+		cellList = cdr(cellList);
 		expressionList = cdr(expressionList);
 	}
 	return evalLetBody(letBody, letFrame);
 }
 
+// Whether a form by this name keeps the frame it is evaluated in, as a
+// lambda's closure or a delayed expression's promise does.
+int capturesFrame(char *form) {
+    return !strcmp(form, "lambda") || !strcmp(form, "delay") ||
+           !strcmp(form, "delay-force") || !strcmp(form, "cons-stream");
+}
+
+/*
+* Whether every place name occurs in expr is as the operator of a call
+* in tail position, so that a named let called name can run as a loop.
+* Tail positions are only followed through if, cond, begin, let and let*;
+* a lambda, delay or define anywhere means the loop's frame could be
+* captured or extended, so those never qualify. Quoted data is skipped.
+*/
+int isLoopSequence(Value *body, char *name);
+
+int isLoopBody(Value *expr, char *name, int tail) {
+    if (expr->type == SYMBOL_TYPE) {
+        return !sameName(expr->s, name);
+    } else if (expr->type != CONS_TYPE) {
+        return 1;
+    }
+    Value *first = car(expr);
+    Value *args = cdr(expr);
+    if (first->type == SYMBOL_TYPE) {
+        if (!strcmp(first->s, "quote")) {
+            return 1;
+        } else if (capturesFrame(first->s) || !strcmp(first->s, "define")) {
+            return 0;
+        } else if (sameName(first->s, name)) {
+            return tail && isLoopBody(args, name, 0);
+        } else if (!strcmp(first->s, "if") && args->type == CONS_TYPE) {
+            if (!isLoopBody(car(args), name, 0)) {
+                return 0;
+            }
+            for (args = cdr(args); args->type == CONS_TYPE; args = cdr(args)) {
+                if (!isLoopBody(car(args), name, tail)) {
+                    return 0;
+                }
+            }
+            return 1;
+        } else if (!strcmp(first->s, "begin")) {
+            return tail ? isLoopSequence(args, name) : isLoopBody(args, name, 0);
+        } else if (!strcmp(first->s, "cond")) {
+            for (; args->type == CONS_TYPE; args = cdr(args)) {
+                Value *clause = car(args);
+                //only the first expression of a clause is evaluated
+                if (clause->type != CONS_TYPE ||
+                    !isLoopBody(car(clause), name, 0) ||
+                    (cdr(clause)->type == CONS_TYPE &&
+                     (!isLoopBody(car(cdr(clause)), name, tail) ||
+                      !isLoopBody(cdr(cdr(clause)), name, 0)))) {
+                    return 0;
+                }
+            }
+            return 1;
+        } else if ((!strcmp(first->s, "let") || !strcmp(first->s, "let*")) &&
+                   args->type == CONS_TYPE &&
+                   car(args)->type != SYMBOL_TYPE) {
+            for (Value *bindings = car(args); bindings->type == CONS_TYPE;
+                 bindings = cdr(bindings)) {
+                //a let that rebinds name hides the loop from its body
+                if (!isLoopBody(car(bindings), name, 0)) {
+                    return 0;
+                }
+            }
+            return tail ? isLoopSequence(cdr(args), name)
+                        : isLoopBody(cdr(args), name, 0);
+        }
+    }
+    for (; expr->type == CONS_TYPE; expr = cdr(expr)) {
+        if (!isLoopBody(car(expr), name, 0)) {
+            return 0;
+        }
+    }
+    return isLoopBody(expr, name, 0);
+}
+
+// Like isLoopBody for a body, whose last expression is in tail position.
+int isLoopSequence(Value *body, char *name) {
+    for (; body->type == CONS_TYPE; body = cdr(body)) {
+        if (!isLoopBody(car(body), name, cdr(body)->type == NULL_TYPE)) {
+            return 0;
+        }
+    }
+    return isLoopBody(body, name, 0);
+}
+
+/*
+* A named let running as a loop: the binding cells of its variables, in
+* order, and room for the values of the next iteration.
+*/
+typedef struct Loop {
+    char *name;
+    int count;
+    Value **cells;
+    Value **next;
+} Loop;
+
+// Returned through the tail positions of a loop body when it calls the
+// loop again; the values for the next iteration are in the loop's next.
+Value loopAgain = {.type = VOID_TYPE};
+
+Value *evalLoopBody(Value *body, Frame *frame, Loop *loop);
+
+/*
+* Evaluates expr, which is in tail position in the body of loop, the
+* way eval would, except that a call to the loop stores its arguments
+* and returns loopAgain. Follows the same forms as isLoopBody.
+*/
+Value *evalLoopTail(Value *expr, Frame *frame, Loop *loop) {
+    if (expr->type != CONS_TYPE || car(expr)->type != SYMBOL_TYPE) {
+        return eval(expr, frame);
+    }
+    char *form = car(expr)->s;
+    Value *args = cdr(expr);
+    if (sameName(form, loop->name)) {
+        int count = 0;
+        for (; args->type == CONS_TYPE; args = cdr(args)) {
+            if (count == loop->count) {
+                evalError("wrong number of parameters passed to function");
+            }
+            loop->next[count++] = eval(car(args), frame);
+        }
+        if (count != loop->count) {
+            evalError("wrong number of parameters passed to function");
+        }
+        return &loopAgain;
+    } else if (!strcmp(form, "if")) {
+        if (length(args) != 3) {
+            evalError("wrong number of arguments for if");
+        }
+        Value *condition = eval(car(args), frame);
+        if (condition->type != BOOL_TYPE) {
+            evalError("non-boolean condition for if");
+        }
+        if (condition->i) {
+            return evalLoopTail(car(cdr(args)), frame, loop);
+        }
+        return evalLoopTail(car(cdr(cdr(args))), frame, loop);
+    } else if (!strcmp(form, "begin") && args->type != NULL_TYPE) {
+        return evalLoopBody(args, frame, loop);
+    } else if (!strcmp(form, "cond")) {
+        if (length(args) == 0) {
+            evalError("no arguments in cond");
+        }
+        while (args->type != NULL_TYPE) {
+            Value *condition = car(car(args));
+            if (condition->type == SYMBOL_TYPE &&
+                !strcmp(condition->s, "else")) {
+                if (cdr(args)->type != NULL_TYPE) {
+                    evalError("else is not last test in cond");
+                }
+                return evalLoopTail(car(cdr(car(args))), frame, loop);
+            }
+            condition = eval(condition, frame);
+            if (condition->type != BOOL_TYPE) {
+                evalError("non-boolean condition for if");
+            } else if (condition->i) {
+                return evalLoopTail(car(cdr(car(args))), frame, loop);
+            }
+            args = cdr(args);
+        }
+        Value *voidVal = makeNull();
+        voidVal->type = VOID_TYPE;
+        return voidVal;
+    } else if (!strcmp(form, "let") && args->type == CONS_TYPE &&
+               car(args)->type != SYMBOL_TYPE) {
+        return evalLoopBody(cdr(args), makeLetFrame(args, frame), loop);
+    } else if (!strcmp(form, "let*")) {
+        Value *letBody = args->type == CONS_TYPE ? cdr(args) : makeNull();
+        return evalLoopBody(letBody, makeLetStarFrame(args, frame), loop);
+    }
+    return eval(expr, frame);
+}
+
+// Evaluates a body of a loop, its last expression in tail position.
+Value *evalLoopBody(Value *body, Frame *frame, Loop *loop) {
+    if (body->type == NULL_TYPE) {
+        evalError("no body in let");
+    }
+    while (cdr(body)->type != NULL_TYPE) {
+        eval(car(body), frame);
+        body = cdr(body);
+    }
+    return evalLoopTail(car(body), frame, loop);
+}
+
+/*
+* Evaluates (let name ((var init) ...) body ...). When the body only
+* calls name in tail position and makes no closures, it runs as a loop
+* in one frame whose bindings are updated in place on each call, so an
+* iteration allocates no frame and uses no C stack. Otherwise name is
+* bound to a procedure over the variables, in a frame of its own, and
+* called with the initial values.
+*/
+Value *evalNamedLet(Value *letArgs, Frame *frame) {
+    Value *name = car(letArgs);
+    if (cdr(letArgs)->type != CONS_TYPE) {
+        evalError("no bindings in named let");
+    }
+    Value *bindingList = car(cdr(letArgs));
+    Value *body = cdr(cdr(letArgs));
+    if (bindingList->type != CONS_TYPE && bindingList->type != NULL_TYPE) {
+        evalError("improper variable binding format in let");
+    } else if (body->type == NULL_TYPE) {
+        evalError("no body in let");
+    }
+    Frame *loopFrame = talloc(sizeof(Frame));
+    COUNT_FRAME();
+    loopFrame->parent = frame;
+    loopFrame->bindings = makeNull();
+    loopFrame->code = letArgs;
+    if (isLoopSequence(body, name->s)) {
+        Loop loop;
+        loop.name = name->s;
+        loop.count = length(bindingList);
+        loop.cells = talloc(loop.count * sizeof(Value *));
+        loop.next = talloc(loop.count * sizeof(Value *));
+        for (int i = 0; i < loop.count; i++) {
+            bindLetArg(bindingList, frame, loopFrame);
+            loop.cells[i] = car(loopFrame->bindings);
+            bindingList = cdr(bindingList);
+        }
+        while (1) {
+            Value *result = evalLoopBody(body, loopFrame, &loop);
+            if (result != &loopAgain) {
+                return result;
+            }
+            for (int i = 0; i < loop.count; i++) {
+                loop.cells[i]->c.cdr = loop.next[i];
+            }
+        }
+    }
+    //the general case: name is a procedure that can be called from anywhere
+    Frame *initFrame = talloc(sizeof(Frame));
+    initFrame->parent = frame;
+    initFrame->bindings = makeNull();
+    initFrame->code = letArgs;
+    Value *params = makeNull();
+    Value *inits = makeNull();
+    while (bindingList->type != NULL_TYPE) {
+        bindLetArg(bindingList, frame, initFrame);
+        params = cons(car(car(initFrame->bindings)), params);
+        inits = cons(cdr(car(initFrame->bindings)), inits);
+        bindingList = cdr(bindingList);
+    }
+    if (cdr(body)->type != NULL_TYPE) {
+        Value *begin = makeNull();
+        begin->type = SYMBOL_TYPE;
+        begin->s = internSymbol("begin", 5);
+        body = cons(begin, body);
+    } else {
+        body = car(body);
+    }
+    Value *procedure = makeNull();
+    procedure->type = CLOSURE_TYPE;
+    procedure->closure.paramNames = reverse(params);
+    procedure->closure.fnBody = body;
+    procedure->closure.frame = loopFrame;
+    loopFrame->bindings = cons(cons(name, procedure), loopFrame->bindings);
+    return apply(procedure, reverse(inits));
+}
+
+Value *evalBegin(Value *args, Frame *frame);
+
+// Whether expr contains a lambda or delay outside of quoted data.
+int containsLambda(Value *expr) {
+    if (expr->type != CONS_TYPE) {
+        return 0;
+    }
+    if (car(expr)->type == SYMBOL_TYPE) {
+        if (!strcmp(car(expr)->s, "quote")) {
+            return 0;
+        } else if (capturesFrame(car(expr)->s)) {
+            return 1;
+        }
+    }
+    for (; expr->type == CONS_TYPE; expr = cdr(expr)) {
+        if (containsLambda(car(expr))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+* Evaluates (do ((var init step) ...) (test expr ...) command ...). The
+* variables live in one frame whose bindings are updated in place after
+* each iteration, unless the loop makes closures, which could capture an
+* iteration's bindings; then each iteration gets a fresh frame.
+*/
+Value *evalDo(Value *args, Frame *frame) {
+    if (length(args) < 2) {
+        evalError("too few arguments in do");
+    }
+    Value *specs = car(args);
+    Value *exit = car(cdr(args));
+    Value *commands = cdr(cdr(args));
+    if (specs->type != CONS_TYPE && specs->type != NULL_TYPE) {
+        evalError("improper variable binding format in do");
+    } else if (exit->type != CONS_TYPE) {
+        evalError("no test in do");
+    }
+    int count = length(specs);
+    Value **cells = talloc(count * sizeof(Value *));
+    Value **steps = talloc(count * sizeof(Value *));
+    Value **next = talloc(count * sizeof(Value *));
+    Frame *loopFrame = talloc(sizeof(Frame));
+    COUNT_FRAME();
+    loopFrame->parent = frame;
+    loopFrame->bindings = makeNull();
+    loopFrame->code = args;
+    for (int i = 0; i < count; i++) {
+        Value *spec = car(specs);
+        if (spec->type != CONS_TYPE || car(spec)->type != SYMBOL_TYPE ||
+            cdr(spec)->type != CONS_TYPE || length(spec) > 3) {
+            evalError("improper variable format in do");
+        } else if (contains(loopFrame->bindings, car(spec))) {
+            evalError("duplicate bound variable in do");
+        }
+        Value *init = eval(car(cdr(spec)), frame);
+        loopFrame->bindings = cons(cons(car(spec), init),
+                                   loopFrame->bindings);
+        cells[i] = car(loopFrame->bindings);
+        steps[i] = cdr(cdr(spec))->type == CONS_TYPE ? car(cdr(cdr(spec)))
+                                                    : NULL;
+        specs = cdr(specs);
+    }
+    int reuseFrame = !containsLambda(args);
+    while (1) {
+        Value *test = eval(car(exit), loopFrame);
+        if (test->type != BOOL_TYPE) {
+            evalError("non-boolean test in do");
+        } else if (test->i) {
+            return evalBegin(cdr(exit), loopFrame);
+        }
+        for (Value *command = commands; command->type != NULL_TYPE;
+             command = cdr(command)) {
+            eval(car(command), loopFrame);
+        }
+        for (int i = 0; i < count; i++) {
+            next[i] = steps[i] != NULL ? eval(steps[i], loopFrame)
+                                       : cdr(cells[i]);
+        }
+        if (!reuseFrame) {
+            Frame *iterationFrame = talloc(sizeof(Frame));
+            COUNT_FRAME();
+            iterationFrame->parent = frame;
+            iterationFrame->bindings = makeNull();
+            iterationFrame->code = args;
+            for (int i = count - 1; i >= 0; i--) {
+                cells[i] = cons(car(cells[i]), next[i]);
+                iterationFrame->bindings = cons(cells[i],
+                                                iterationFrame->bindings);
+            }
+            loopFrame = iterationFrame;
+        } else {
+            for (int i = 0; i < count; i++) {
+                cells[i]->c.cdr = next[i];
+            }
+        }
+    }
+}
+
+/*
+* Evaluates (delay expr), (delay-force expr) and (cons-stream item expr),
+* which all leave expr to run when the promise for it is forced.
+*/
+Value *evalDelay(char *form, Value *args, Frame *frame) {
+    if (!strcmp(form, "cons-stream")) {
+        if (length(args) != 2) {
+            evalError("cons-stream expects an item and an expression");
+        }
+        return cons(eval(car(args), frame),
+                    makePromise(car(cdr(args)), frame, 0));
+    }
+    if (length(args) != 1) {
+        evalError("delay expects a single expression");
+    }
+    return makePromise(car(args), frame, !strcmp(form, "delay-force"));
+}
+
 Value *evalQuote(Value *args) {
     if (args->type == NULL_TYPE || cdr(args)->type != NULL_TYPE) {
         evalError("quote has more than 1 argument");
@@ -544,6 +1448,9 @@ Value *evalDefine(Value *args, Frame *frame){
         evalError("non-symbol cannot be bound to a value in define");
     }
     Value *binding = cons(car(args), eval(car(cdr(args)), frame));
+    if (profilerRunning && cdr(binding)->type == CLOSURE_TYPE) {
+        nameProcedure(cdr(binding)->closure.fnBody, car(args)->s);
+    }
     Value *temp = cons(binding, frame->bindings);
     frame->bindings = temp;
     Value *voidVal = makeNull();
@@ -556,26 +1463,20 @@ Value *evalDefine(Value *args, Frame *frame){
 * the binding already exists. Returns 1 if successful, 0 if not.
 */
 int setBinding(Value *variable, Value *newVal, Frame *frame){
-    int isBound = 0;
-    do {
+    while (frame != NULL) {
         Value *bindings = frame->bindings;
         while(bindings->type != NULL_TYPE){
             Value *binding = car(bindings);
-            if (!strcmp(car(binding)->s, variable->s)) {
-                isBound = 1;
+            if (sameName(car(binding)->s, variable->s)) {
                 binding->c.cdr = newVal;
-                break;
+                return 1;
             }
             bindings = cdr(bindings);
         }
-        if (frame->parent != NULL) {
-            frame = frame->parent;
-        } else {
-            //in global frame; don't look any further
-            break;
-        }  
-    } while (frame->parent != NULL);
-    return isBound;
+        //the global frame is the last one searched
+        frame = frame->parent;
+    }
+    return 0;
 }
 
 Value *evalSet(Value *args, Frame *frame){
@@ -619,7 +1520,7 @@ Value *evalLambda(Value *args, Frame *frame){
     newClosure->type = CLOSURE_TYPE;
     newClosure->closure.paramNames = car(args);
     newClosure->closure.fnBody = car(cdr(args));
-    newClosure->closure.frame = frame;
+    newClosure->closure.frame = closureFrame(args, frame);
     return newClosure;
 }
 
@@ -701,7 +1602,7 @@ void bindArgs(Value *varList, Value *valueList, Frame *frame){
         Value *temp = cons(binding, frame->bindings);
         frame->bindings = temp;
         if (frame->bindings->type == NULL_TYPE) {
-            printf("frame binding is null") ;
+            outString("frame binding is null");
         }
         varList = cdr(varList);
         valueList = cdr(valueList);
@@ -717,27 +1618,52 @@ void bindArgs(Value *varList, Value *valueList, Frame *frame){
 */
 Value *evalFnArgs(Value *args, Frame *frame) {
     Value *evaluatedArgs = makeNull();
+    Value *last = NULL;
     while (args->type != NULL_TYPE) {
-        Value *temp = cons(eval(car(args), frame), evaluatedArgs);
-        evaluatedArgs = temp;
+        Value *cell = cons(eval(car(args), frame), makeNull());
+        if (last == NULL) {
+            evaluatedArgs = cell;
+        } else {
+            last->c.cdr = cell;
+        }
+        last = cell;
         args = cdr(args);
     }
-    return reverse(evaluatedArgs);
+    return evaluatedArgs;
 }
 
 /* Applies the closure passed in to the args passed in, creating a 
 * new frame whose parent is the frame pointed to by the closure. 
 */
+Frame *makeCallFrame(Value *function) {
+    COUNT_CLOSURE_APPLICATION();
+    Frame *fnFrame = talloc(sizeof(Frame));
+    COUNT_FRAME();
+    fnFrame->parent = function->closure.frame;
+    fnFrame->bindings = makeNull();
+    fnFrame->code = function->closure.fnBody;
+    return fnFrame;
+}
+
+Value *runClosure(Value *function, Frame *fnFrame) {
+    Value *fnBody = function->closure.fnBody;
+    if (profilerRunning) {
+        enterProcedure(fnBody);
+        Value *result = eval(fnBody, fnFrame);
+        leaveProcedure();
+        return result;
+    }
+    return eval(fnBody, fnFrame);
+}
+
 Value *apply(Value *function, Value *args) {
+    METRICS_SAFE_POINT();
     if (function->type == CLOSURE_TYPE) {
-        Frame *fnFrame = talloc(sizeof(Frame));
-        fnFrame->parent = function->closure.frame;
-        fnFrame->bindings = makeNull();
-        Value *formalParams = function->closure.paramNames;
-        Value *fnBody = function->closure.fnBody;
-        bindArgs(formalParams, args, fnFrame);
-        return eval(fnBody, fnFrame);
+        Frame *fnFrame = makeCallFrame(function);
+        bindArgs(function->closure.paramNames, args, fnFrame);
+        return runClosure(function, fnFrame);
     } else if (function->type == PRIMITIVE_TYPE) {
+        COUNT_PRIMITIVE_CALL(function->primFn);
         return (function->primFn)(args);
     } else {
         evalError("incorrect type for function in apply");
@@ -746,11 +1672,8 @@ Value *apply(Value *function, Value *args) {
     
 }
 
-/* Evaluates the S-expression referred to by expr
-* in the given frame and returns a Value pointer to the result of 
-* the evaluation. 
-*/
-Value *eval(Value *tree, Frame *frame) {
+// Evaluates tree in frame on whatever stack eval has left it on.
+Value *evalHere(Value *tree, Frame *frame) {
     valueType type = tree->type;
     if (type == INT_TYPE || type == DOUBLE_TYPE || 
         type == BOOL_TYPE || type == STR_TYPE) {
@@ -766,37 +1689,82 @@ Value *eval(Value *tree, Frame *frame) {
         Value *first = car(tree);
         Value *args = cdr(tree);
         Value *result;
-        if (!strcmp(first->s,"if")) {
+        Node *node = knownApplication(tree);
+        if (node != NULL) {
+            //a call that has run before
+            COUNT_FORM(FORM_APPLICATION);
+            result = evalApplication(tree, node, frame);
+        } else if (!strcmp(first->s,"if")) {
+            COUNT_FORM(FORM_IF);
             result = evalIf(args, frame);
         } else if (!strcmp(first->s, "let")) {
+            COUNT_FORM(FORM_LET);
             result = evalLet(args, frame);
         } else if (!strcmp(first->s, "quote")) {
+            COUNT_FORM(FORM_QUOTE);
             result = evalQuote(args);
         } else if (!strcmp(first->s, "define")) {
+            COUNT_FORM(FORM_DEFINE);
             result = evalDefine(args, frame);
         } else if (!strcmp(first->s, "lambda")) {
+            COUNT_FORM(FORM_LAMBDA);
             result = evalLambda(args, frame);
         } else if (!strcmp(first->s, "let*")) {
+            COUNT_FORM(FORM_LET_STAR);
 			result = evalLetStar(args, frame);
         } else if (!strcmp(first->s, "letrec")) {
+            COUNT_FORM(FORM_LETREC);
             result = evalLetrec(args, frame);
 		} else if (!strcmp(first->s, "set!")) {
+            COUNT_FORM(FORM_SET);
 			result = evalSet(args, frame);
         } else if (!strcmp(first->s, "begin")) {
+            COUNT_FORM(FORM_BEGIN);
             result = evalBegin(args, frame);
         } else if (!strcmp(first->s, "and")) {
+            COUNT_FORM(FORM_AND);
             result = evalAnd(args, frame);
         } else if (!strcmp(first->s, "or")) {
+            COUNT_FORM(FORM_OR);
             result = evalOr(args, frame);
+        } else if (!strcmp(first->s, "define-syntax")) {
+            //the macro was defined when the form was expanded
+            result = makeNull();
+            result->type = VOID_TYPE;
+        } else if (!strcmp(first->s, "delay") ||
+                   !strcmp(first->s, "delay-force") ||
+                   !strcmp(first->s, "cons-stream")) {
+            COUNT_FORM(FORM_DELAY);
+            result = evalDelay(first->s, args, frame);
+        } else if (!strcmp(first->s, "do")) {
+            COUNT_FORM(FORM_DO);
+            result = evalDo(args, frame);
         } else if (!strcmp(first->s, "cond")) {
+            COUNT_FORM(FORM_COND);
             result = evalCond(args, frame);    
         } else {
             //applying a function
-            args = evalFnArgs(args, frame);
-            Value *function = eval(first, frame);
-            result = apply(function, args);
+            COUNT_FORM(FORM_APPLICATION);
+            result = evalApplication(tree, NULL, frame);
         }
         return result;
     }
     return NULL;    
+}
+
+/* Evaluates the S-expression referred to by expr
+* in the given frame and returns a Value pointer to the result of 
+* the evaluation. 
+*/
+Value *eval(Value *tree, Frame *frame) {
+    char here;
+    if (&here < evalStack.limit) {
+        return evalOnNewSegment(tree, frame);
+    }
+    if (++evalStack.depth > maxEvalDepth) {
+        evalError("recursion deeper than SCHEME_MAX_DEPTH");
+    }
+    Value *result = evalHere(tree, frame);
+    evalStack.depth--;
+    return result;
 }
\ No newline at end of file
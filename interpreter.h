@@ -1,8 +1,86 @@
+#include <stddef.h>
+#include "value.h"
+#include "talloc.h"
+#include "symbol.h"
+#include "macro.h"
+#include "closure.h"
+#include "node.h"
+
 #ifndef _INTERPRETER
 #define _INTERPRETER
 
+// Everything one instance of the interpreter owns: the memory its values
+// live in, its interned names, its macros, what its lambdas refer to, what
+// its calls have specialized on, its global frame and the files it has
+// loaded.
+// Several instances can run at once as long as each is used by one thread
+// at a time.
+typedef struct Interpreter {
+    Allocator allocator;
+    SymbolTable symbols;
+    MacroTable macros;
+    FormTable freeVariables;
+    FormTable definingCode;
+    NodeTable nodes;
+    Frame *globalFrame;
+    struct LoadedFile *loadedFiles;
+} Interpreter;
+
+// Creates an instance with a fresh global frame and makes it the calling
+// thread's current one.
+Interpreter *newInterpreter();
+
+// Makes interp the instance that the calling thread's allocations, symbols,
+// load and makeGlobalFrame use.
+void useInterpreter(Interpreter *interp);
+
+// The instance the calling thread is running.
+Interpreter *currentInterpreter();
+
+// Makes interp the calling thread's current instance for its tables and
+// global frame only, and returns the one it replaces. Future workers run a
+// task for the instance that submitted it this way; they keep allocating
+// from their own blocks, since an instance's aren't safe to share between
+// threads.
+Interpreter *borrowInterpreter(Interpreter *interp);
+
+// Frees everything the instance allocated, and the instance itself.
+void freeInterpreter(Interpreter *interp);
+
+// Evaluates every form in text[0, length) in interp's global frame and
+// prints the results, as the REPL would. An error is printed and ends the
+// evaluation of text without ending the program; what the forms before it
+// did stays done. Returns 1 after an error and 0 otherwise. Only this entry
+// point carries on after errors: the others exit, as the standalone program
+// does.
+int interpretString(Interpreter *interp, const char *text, size_t length);
+
 void interpret(Value *tree);
+Frame *makeGlobalFrame();
+void interpretInFrame(Value *tree, Frame *frame);
+void interpretExpr(Value *expr, Frame *frame);
+void loadFile(char *path, Frame *frame, int printResults);
+void setGlobalFrame(Frame *frame);
+int primitiveIndex(Value *(*function)(Value *));
+Value *(*primitiveAt(int index))(Value *);
 Value *eval(Value *expr, Frame *frame);
+Value *evalFnArgs(Value *args, Frame *frame);
+Value *apply(Value *function, Value *args);
+
+// The two halves of applying a closure: making the frame it runs in, and
+// running its body once its parameters are bound there.
+Frame *makeCallFrame(Value *function);
+Value *runClosure(Value *function, Frame *fnFrame);
+
+// The primitives that application nodes specialize calls of.
+Value *primitiveAdd(Value *args);
+Value *primitiveSubtract(Value *args);
+Value *primitiveMultiply(Value *args);
+Value *primitiveDivide(Value *args);
+Value *primitiveLess(Value *args);
+Value *primitiveGreater(Value *args);
+Value *primitiveEqual(Value *args);
+void evalError(char *errorMessage);
 
 #endif
 
@@ -75,6 +75,13 @@ void displayValue(Value *item) {
       break;
     case PRIMITIVE_TYPE:
       break;
+    case FUTURE_TYPE:
+      break;
+    case CHANNEL_TYPE:
+      break;
+    case PROMISE_TYPE:
+      printf("#<promise>");
+      break;
   }
 }
 
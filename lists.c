@@ -0,0 +1,436 @@
+/* Native implementations of the core list procedures. */
+#include <string.h>
+#include "lists.h"
+#include "interpreter.h"
+#include "linkedlist.h"
+#include "symbol.h"
+#include "talloc.h"
+#include "metrics.h"
+
+int isEqual(Value *value1, Value *value2) {
+    //walk down cdrs in a loop; only nesting in cars recurses
+    while (value1->type == CONS_TYPE && value2->type == CONS_TYPE) {
+        if (value1 != value2 && !isEqual(car(value1), car(value2))) {
+            return 0;
+        }
+        value1 = cdr(value1);
+        value2 = cdr(value2);
+    }
+    if (value1 == value2) {
+        return 1;
+    } else if (value1->type != value2->type) {
+        return 0;
+    }
+    switch (value1->type) {
+        case INT_TYPE:
+        case BOOL_TYPE:
+            return value1->i == value2->i;
+        case DOUBLE_TYPE:
+            return value1->d == value2->d;
+        case STR_TYPE:
+        case SYMBOL_TYPE:
+            return sameName(value1->s, value2->s);
+        case NULL_TYPE:
+        case VOID_TYPE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+Value *makeBoolean(int truth) {
+    Value *boolean = makeNull();
+    boolean->type = BOOL_TYPE;
+    boolean->i = truth;
+    return boolean;
+}
+
+// Returns the non-negative integer argument of a list primitive.
+int indexArgument(Value *value, char *message) {
+    if (value->type != INT_TYPE || value->i < 0) {
+        evalError(message);
+    }
+    return value->i;
+}
+
+Value *primitiveList(Value *args) {
+    Value *list = makeNull();
+    Value *last = NULL;
+    for (; args->type == CONS_TYPE; args = cdr(args)) {
+        Value *cell = cons(car(args), makeNull());
+        if (last == NULL) {
+            list = cell;
+        } else {
+            last->c.cdr = cell;
+        }
+        last = cell;
+    }
+    return list;
+}
+
+Value *primitiveLength(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for length");
+    }
+    Value *list = car(args);
+    int count = 0;
+    while (list->type == CONS_TYPE) {
+        count++;
+        list = cdr(list);
+    }
+    if (list->type != NULL_TYPE) {
+        evalError("length expects a proper list");
+    }
+    Value *result = makeNull();
+    result->type = INT_TYPE;
+    result->i = count;
+    return result;
+}
+
+Value *primitiveAppend(Value *args) {
+    if (args->type == NULL_TYPE) {
+        return makeNull();
+    }
+    Value *result = makeNull();
+    Value *last = NULL;
+    while (cdr(args)->type != NULL_TYPE) {
+        Value *list = car(args);
+        for (; list->type == CONS_TYPE; list = cdr(list)) {
+            Value *cell = cons(car(list), makeNull());
+            if (last == NULL) {
+                result = cell;
+            } else {
+                last->c.cdr = cell;
+            }
+            last = cell;
+        }
+        if (list->type != NULL_TYPE) {
+            evalError("append expects proper lists");
+        }
+        args = cdr(args);
+    }
+    if (last == NULL) {
+        return car(args);
+    }
+    last->c.cdr = car(args);
+    return result;
+}
+
+Value *primitiveReverse(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for reverse");
+    }
+    Value *list = car(args);
+    Value *result = makeNull();
+    for (; list->type == CONS_TYPE; list = cdr(list)) {
+        result = cons(car(list), result);
+    }
+    if (list->type != NULL_TYPE) {
+        evalError("reverse expects a proper list");
+    }
+    return result;
+}
+
+Value *primitiveListTail(Value *args) {
+    if (length(args) != 2) {
+        evalError("wrong number of args for list-tail");
+    }
+    Value *list = car(args);
+    int count = indexArgument(car(cdr(args)),
+                              "list-tail expects a non-negative index");
+    for (int i = 0; i < count; i++) {
+        if (list->type != CONS_TYPE) {
+            evalError("index out of range in list-tail");
+        }
+        list = cdr(list);
+    }
+    return list;
+}
+
+Value *primitiveListRef(Value *args) {
+    if (length(args) != 2) {
+        evalError("wrong number of args for list-ref");
+    }
+    Value *list = car(args);
+    int index = indexArgument(car(cdr(args)),
+                              "list-ref expects a non-negative index");
+    for (int i = 0; i < index && list->type == CONS_TYPE; i++) {
+        list = cdr(list);
+    }
+    if (list->type != CONS_TYPE) {
+        evalError("index out of range in list-ref");
+    }
+    return car(list);
+}
+
+Value *primitiveMember(Value *args) {
+    if (length(args) != 2) {
+        evalError("wrong number of args for member");
+    }
+    Value *item = car(args);
+    Value *list = car(cdr(args));
+    for (; list->type == CONS_TYPE; list = cdr(list)) {
+        if (isEqual(item, car(list))) {
+            return list;
+        }
+    }
+    if (list->type != NULL_TYPE) {
+        evalError("member expects a proper list");
+    }
+    return makeBoolean(0);
+}
+
+Value *primitiveAssoc(Value *args) {
+    if (length(args) != 2) {
+        evalError("wrong number of args for assoc");
+    }
+    Value *key = car(args);
+    Value *list = car(cdr(args));
+    for (; list->type == CONS_TYPE; list = cdr(list)) {
+        Value *pair = car(list);
+        if (pair->type != CONS_TYPE) {
+            evalError("assoc expects a list of pairs");
+        }
+        if (isEqual(key, car(pair))) {
+            return pair;
+        }
+    }
+    if (list->type != NULL_TYPE) {
+        evalError("assoc expects a proper list");
+    }
+    return makeBoolean(0);
+}
+
+// Calls function with args, going straight to the C function of a
+// primitive.
+Value *callProcedure(Value *function, Value *args) {
+    if (function->type == PRIMITIVE_TYPE) {
+        COUNT_PRIMITIVE_CALL(function->primFn);
+        return function->primFn(args);
+    }
+    return apply(function, args);
+}
+
+// Checks that function is a procedure, for the primitive called name.
+void procedureArgument(Value *function, char *message) {
+    if (function->type != CLOSURE_TYPE && function->type != PRIMITIVE_TYPE) {
+        evalError(message);
+    }
+}
+
+/*
+* The argument list a higher-order primitive passes to its procedure on
+* every call: count cells, plus an extra one in front when extra is set,
+* which the caller fills in itself.
+*/
+typedef struct ArgumentBuffer {
+    Value *list;
+    Value *items;
+} ArgumentBuffer;
+
+void makeArgumentBuffer(ArgumentBuffer *buffer, int count, int extra) {
+    buffer->list = makeNull();
+    for (int i = 0; i < count + extra; i++) {
+        buffer->list = cons(makeNull(), buffer->list);
+    }
+    buffer->items = extra ? cdr(buffer->list) : buffer->list;
+}
+
+// Fills the buffer with the cars of lists and advances each list. Returns
+// 0, filling nothing, if any list has run out.
+int nextArguments(ArgumentBuffer *buffer, Value **lists, int count) {
+    for (int i = 0; i < count; i++) {
+        if (lists[i]->type != CONS_TYPE) {
+            return 0;
+        }
+    }
+    Value *cell = buffer->items;
+    for (int i = 0; i < count; i++) {
+        cell->c.car = car(lists[i]);
+        lists[i] = cdr(lists[i]);
+        cell = cdr(cell);
+    }
+    return 1;
+}
+
+// Collects the list arguments that follow the procedure (and init).
+Value **listArguments(Value *args, int *count, char *message) {
+    *count = length(args);
+    if (*count == 0) {
+        evalError(message);
+    }
+    Value **lists = talloc(*count * sizeof(Value *));
+    for (int i = 0; i < *count; i++) {
+        lists[i] = car(args);
+        if (lists[i]->type != CONS_TYPE && lists[i]->type != NULL_TYPE) {
+            evalError(message);
+        }
+        args = cdr(args);
+    }
+    return lists;
+}
+
+// map and for-each, keeping the results when collect is set.
+Value *mapLists(Value *args, int collect, char *message) {
+    if (args->type != CONS_TYPE) {
+        evalError(message);
+    }
+    Value *function = car(args);
+    procedureArgument(function, message);
+    int count;
+    Value **lists = listArguments(cdr(args), &count, message);
+    ArgumentBuffer buffer;
+    makeArgumentBuffer(&buffer, count, 0);
+    Value *result = makeNull();
+    Value *last = NULL;
+    while (nextArguments(&buffer, lists, count)) {
+        Value *item = callProcedure(function, buffer.list);
+        if (!collect) {
+            continue;
+        }
+        Value *cell = cons(item, makeNull());
+        if (last == NULL) {
+            result = cell;
+        } else {
+            last->c.cdr = cell;
+        }
+        last = cell;
+    }
+    if (!collect) {
+        result = makeNull();
+        result->type = VOID_TYPE;
+    }
+    return result;
+}
+
+Value *primitiveMap(Value *args) {
+    return mapLists(args, 1, "map expects a procedure and lists");
+}
+
+Value *primitiveForEach(Value *args) {
+    return mapLists(args, 0, "for-each expects a procedure and lists");
+}
+
+Value *primitiveFilter(Value *args) {
+    if (length(args) != 2) {
+        evalError("wrong number of args for filter");
+    }
+    Value *function = car(args);
+    procedureArgument(function, "filter expects a procedure");
+    Value *list = car(cdr(args));
+    ArgumentBuffer buffer;
+    makeArgumentBuffer(&buffer, 1, 0);
+    Value *result = makeNull();
+    Value *last = NULL;
+    while (nextArguments(&buffer, &list, 1)) {
+        Value *item = car(buffer.items);
+        Value *keep = callProcedure(function, buffer.list);
+        if (keep->type == BOOL_TYPE && !keep->i) {
+            continue;
+        }
+        Value *cell = cons(item, makeNull());
+        if (last == NULL) {
+            result = cell;
+        } else {
+            last->c.cdr = cell;
+        }
+        last = cell;
+    }
+    if (list->type != NULL_TYPE) {
+        evalError("filter expects a proper list");
+    }
+    return result;
+}
+
+Value *primitiveFoldLeft(Value *args) {
+    char *message = "fold-left expects a procedure, an initial value and lists";
+    if (length(args) < 3) {
+        evalError(message);
+    }
+    Value *function = car(args);
+    procedureArgument(function, message);
+    Value *accumulator = car(cdr(args));
+    int count;
+    Value **lists = listArguments(cdr(cdr(args)), &count, message);
+    ArgumentBuffer buffer;
+    makeArgumentBuffer(&buffer, count, 1);
+    while (nextArguments(&buffer, lists, count)) {
+        buffer.list->c.car = accumulator;
+        accumulator = callProcedure(function, buffer.list);
+    }
+    return accumulator;
+}
+
+Value *primitiveFoldRight(Value *args) {
+    char *message = "fold-right expects a procedure, an initial value and lists";
+    if (length(args) < 3) {
+        evalError(message);
+    }
+    Value *function = car(args);
+    procedureArgument(function, message);
+    Value *accumulator = car(cdr(args));
+    int count;
+    Value **lists = listArguments(cdr(cdr(args)), &count, message);
+    //the items are needed back to front, so gather them first
+    int rows = 0;
+    for (Value *list = lists[0]; list->type == CONS_TYPE; list = cdr(list)) {
+        rows++;
+    }
+    for (int i = 1; i < count; i++) {
+        int items = 0;
+        for (Value *list = lists[i]; list->type == CONS_TYPE && items < rows;
+             list = cdr(list)) {
+            items++;
+        }
+        rows = items;
+    }
+    Value **items = talloc((size_t)rows * count * sizeof(Value *));
+    for (int i = 0; i < count; i++) {
+        Value *list = lists[i];
+        for (int row = 0; row < rows; row++) {
+            items[row * count + i] = car(list);
+            list = cdr(list);
+        }
+    }
+    ArgumentBuffer buffer;
+    makeArgumentBuffer(&buffer, count + 1, 0);
+    for (int row = rows - 1; row >= 0; row--) {
+        Value *cell = buffer.list;
+        for (int i = 0; i < count; i++) {
+            cell->c.car = items[row * count + i];
+            cell = cdr(cell);
+        }
+        cell->c.car = accumulator;
+        accumulator = callProcedure(function, buffer.list);
+    }
+    return accumulator;
+}
+
+Value *primitiveApply(Value *args) {
+    if (length(args) < 2) {
+        evalError("apply expects a procedure and a list");
+    }
+    Value *function = car(args);
+    procedureArgument(function, "apply expects a procedure and a list");
+    args = cdr(args);
+    if (cdr(args)->type == NULL_TYPE) {
+        Value *list = car(args);
+        if (list->type != CONS_TYPE && list->type != NULL_TYPE) {
+            evalError("apply expects a list as its last argument");
+        }
+        return callProcedure(function, list);
+    }
+    //the leading arguments go in front of the items of the list
+    Value *leading = makeNull();
+    for (; cdr(args)->type != NULL_TYPE; args = cdr(args)) {
+        leading = cons(car(args), leading);
+    }
+    Value *list = car(args);
+    if (list->type != CONS_TYPE && list->type != NULL_TYPE) {
+        evalError("apply expects a list as its last argument");
+    }
+    for (; leading->type != NULL_TYPE; leading = cdr(leading)) {
+        list = cons(car(leading), list);
+    }
+    return callProcedure(function, list);
+}
@@ -0,0 +1,66 @@
+#include "value.h"
+
+#ifndef _LISTS
+#define _LISTS
+
+// The core list library, as primitives. Each walks its lists in a loop and
+// allocates only the cells of its result; results share structure with
+// their arguments where Scheme allows it. The higher-order ones call
+// primitives directly, and hand closures one argument list that is reused
+// for every call, since binding the arguments copies them out of it.
+
+// Whether two values are equal? in the Scheme sense: the same number,
+// boolean, string or symbol, or lists whose elements are equal?. Other
+// values are equal only to themselves.
+int isEqual(Value *value1, Value *value2);
+
+// (list item ...): a new list of the arguments.
+Value *primitiveList(Value *args);
+
+// (length list): the number of items in a proper list.
+Value *primitiveLength(Value *args);
+
+// (append list ...): the items of every list in order. The last argument
+// is shared, not copied, and may be any value.
+Value *primitiveAppend(Value *args);
+
+// (reverse list): a new list of the items in reverse order.
+Value *primitiveReverse(Value *args);
+
+// (list-tail list k): list without its first k items.
+Value *primitiveListTail(Value *args);
+
+// (list-ref list k): item k of list, counting from 0.
+Value *primitiveListRef(Value *args);
+
+// (member item list): the first tail of list whose car is equal? to item,
+// or #f.
+Value *primitiveMember(Value *args);
+
+// (assoc key alist): the first pair in alist whose car is equal? to key,
+// or #f.
+Value *primitiveAssoc(Value *args);
+
+// (map f list ...): a list of f applied to the items of the lists in turn,
+// as long as the shortest list.
+Value *primitiveMap(Value *args);
+
+// (for-each f list ...): like map, for f's effects only.
+Value *primitiveForEach(Value *args);
+
+// (filter pred list): the items of list for which pred isn't #f, in order.
+Value *primitiveFilter(Value *args);
+
+// (fold-left f init list ...): (f (f init a1 b1 ...) a2 b2 ...) and so on,
+// from the front of the lists.
+Value *primitiveFoldLeft(Value *args);
+
+// (fold-right f init list ...): (f a1 b1 ... (f a2 b2 ... init)) and so
+// on, from the back of the lists.
+Value *primitiveFoldRight(Value *args);
+
+// (apply f arg ... list): calls f with the args followed by the items of
+// list.
+Value *primitiveApply(Value *args);
+
+#endif
@@ -0,0 +1,725 @@
+/* syntax-rules macros. Uses are expanded by a pass over each top-level form
+ * between reading and evaluation: a use is matched against the rules of its
+ * macro and replaced, in a rebuilt copy of the form, with the filled-in
+ * template. Names that a template binds with lambda, let, let*, letrec or
+ * do, and that don't come from the use, are renamed in each expansion so
+ * they can't capture the user's variables. Free names in a template are
+ * not renamed, so they resolve where the macro is used. */
+#include <stdio.h>
+#include <string.h>
+#include "macro.h"
+#include "interpreter.h"
+#include "linkedlist.h"
+#include "lists.h"
+#include "symbol.h"
+#include "talloc.h"
+
+// Expansions of one use beyond this are taken to be a macro that never
+// stops expanding into another use.
+#define MAX_EXPANSIONS 10000
+
+// A macro defined by (define-syntax name (syntax-rules literals rule ...)).
+typedef struct Macro {
+    char *name;
+    Value *literals;
+    Value *rules;
+    struct Macro *next;
+} Macro;
+
+/*
+* What a pattern variable matched. At depth 0 value is the matched form; a
+* variable under n ellipses has depth n and a list of the values one depth
+* down, one per repetition. Renamed binders are kept in the same list with
+* depth -1 and their new symbol as the value.
+*/
+typedef struct Match {
+    char *name;
+    int depth;
+    Value *value;
+    struct Match *next;
+} Match;
+
+int isSymbolNamed(Value *value, char *name) {
+    return value->type == SYMBOL_TYPE && !strcmp(value->s, name);
+}
+
+int isEllipsis(Value *value) {
+    return isSymbolNamed(value, "...");
+}
+
+// Whether name is in the list of symbols.
+int inSymbolList(char *name, Value *list) {
+    for (; list->type == CONS_TYPE; list = cdr(list)) {
+        if (car(list)->type == SYMBOL_TYPE && sameName(car(list)->s, name)) {
+            return 1;
+        }
+    }
+    return list->type == SYMBOL_TYPE && sameName(list->s, name);
+}
+
+Match *findMatch(Match *matches, char *name) {
+    for (; matches != NULL; matches = matches->next) {
+        if (sameName(matches->name, name)) {
+            return matches;
+        }
+    }
+    return NULL;
+}
+
+Match *addMatch(Match *matches, char *name, int depth, Value *value) {
+    Match *match = talloc(sizeof(Match));
+    match->name = name;
+    match->depth = depth;
+    match->value = value;
+    match->next = matches;
+    return match;
+}
+
+Macro *findMacro(char *name) {
+    Macro *macro = currentInterpreter()->macros.macros;
+    for (; macro != NULL; macro = macro->next) {
+        if (sameName(macro->name, name)) {
+            return macro;
+        }
+    }
+    return NULL;
+}
+
+// Records a macro, replacing any of the same name.
+void addMacro(char *name, Value *literals, Value *rules) {
+    Macro *macro = findMacro(name);
+    if (macro == NULL) {
+        MacroTable *table = &currentInterpreter()->macros;
+        macro = talloc(sizeof(Macro));
+        macro->name = name;
+        macro->next = table->macros;
+        table->macros = macro;
+    }
+    macro->literals = literals;
+    macro->rules = rules;
+}
+
+/*
+* Checks the arguments of a define-syntax form and returns the macro they
+* define, without recording it anywhere.
+*/
+Macro *parseSyntax(Value *args) {
+    if (length(args) != 2 || car(args)->type != SYMBOL_TYPE) {
+        evalError("define-syntax expects a name and syntax-rules");
+    }
+    Value *spec = car(cdr(args));
+    if (spec->type != CONS_TYPE || !isSymbolNamed(car(spec), "syntax-rules") ||
+        cdr(spec)->type != CONS_TYPE) {
+        evalError("define-syntax only supports syntax-rules");
+    }
+    Value *literals = car(cdr(spec));
+    if (literals->type != CONS_TYPE && literals->type != NULL_TYPE) {
+        evalError("bad literals list in syntax-rules");
+    }
+    for (Value *rules = cdr(cdr(spec)); rules->type != NULL_TYPE;
+         rules = cdr(rules)) {
+        Value *rule = car(rules);
+        if (rule->type != CONS_TYPE || length(rule) != 2 ||
+            car(rule)->type != CONS_TYPE) {
+            evalError("bad rule in syntax-rules");
+        }
+    }
+    Macro *macro = talloc(sizeof(Macro));
+    macro->name = car(args)->s;
+    macro->literals = literals;
+    macro->rules = cdr(cdr(spec));
+    macro->next = NULL;
+    return macro;
+}
+
+Value *macroDefinitions() {
+    Value *definitions = makeNull();
+    for (Macro *macro = currentInterpreter()->macros.macros; macro != NULL;
+         macro = macro->next) {
+        Value *name = makeNull();
+        name->type = SYMBOL_TYPE;
+        name->s = macro->name;
+        definitions = cons(cons(name, cons(macro->literals, macro->rules)),
+                           definitions);
+    }
+    return definitions;
+}
+
+void defineMacros(Value *definitions) {
+    for (; definitions->type == CONS_TYPE; definitions = cdr(definitions)) {
+        Value *definition = car(definitions);
+        addMacro(car(definition)->s, car(cdr(definition)),
+                 cdr(cdr(definition)));
+    }
+}
+
+/* Matching */
+
+// Adds the pattern variables of pattern to matches, with no values, at the
+// depth they'd have inside depth ellipses.
+Match *patternVariables(Value *pattern, Macro *macro, int depth,
+                        Match *matches) {
+    while (pattern->type == CONS_TYPE) {
+        int repeated = cdr(pattern)->type == CONS_TYPE &&
+                       isEllipsis(car(cdr(pattern)));
+        matches = patternVariables(car(pattern), macro, depth + repeated,
+                                   matches);
+        pattern = repeated ? cdr(cdr(pattern)) : cdr(pattern);
+    }
+    if (pattern->type == SYMBOL_TYPE && !isSymbolNamed(pattern, "_") &&
+        !isEllipsis(pattern) && !inSymbolList(pattern->s, macro->literals)) {
+        matches = addMatch(matches, pattern->s, depth, NULL);
+    }
+    return matches;
+}
+
+int matchPattern(Value *pattern, Value *form, Macro *macro, Match **matches);
+
+/*
+* Matches the list pattern (item ... rest) against form, where item is
+* repeated as often as the items of form leave enough for rest.
+*/
+int matchRepeated(Value *pattern, Value *form, Macro *macro,
+                  Match **matches) {
+    Value *item = car(pattern);
+    Value *rest = cdr(cdr(pattern));
+    int needed = 0;
+    for (Value *tail = rest; tail->type == CONS_TYPE; tail = cdr(tail)) {
+        needed++;
+    }
+    int available = 0;
+    for (Value *tail = form; tail->type == CONS_TYPE; tail = cdr(tail)) {
+        available++;
+    }
+    if (available < needed) {
+        return 0;
+    }
+    //each variable of item collects its values, last repetition first
+    Match *variables = patternVariables(item, macro, 0, NULL);
+    for (int i = 0; i < available - needed; i++) {
+        Match *itemMatches = NULL;
+        if (!matchPattern(item, car(form), macro, &itemMatches)) {
+            return 0;
+        }
+        for (Match *variable = variables; variable != NULL;
+             variable = variable->next) {
+            Match *found = findMatch(itemMatches, variable->name);
+            variable->value = cons(found->value, variable->value != NULL
+                                                     ? variable->value
+                                                     : makeNull());
+        }
+        form = cdr(form);
+    }
+    for (Match *variable = variables; variable != NULL;
+         variable = variable->next) {
+        Value *values = variable->value != NULL ? reverse(variable->value)
+                                                : makeNull();
+        *matches = addMatch(*matches, variable->name, variable->depth + 1,
+                            values);
+    }
+    return matchPattern(rest, form, macro, matches);
+}
+
+/*
+* Matches form against pattern, adding what its pattern variables matched
+* to matches. Returns whether it matched.
+*/
+int matchPattern(Value *pattern, Value *form, Macro *macro, Match **matches) {
+    while (pattern->type == CONS_TYPE) {
+        if (cdr(pattern)->type == CONS_TYPE && isEllipsis(car(cdr(pattern)))) {
+            return matchRepeated(pattern, form, macro, matches);
+        }
+        if (form->type != CONS_TYPE ||
+            !matchPattern(car(pattern), car(form), macro, matches)) {
+            return 0;
+        }
+        pattern = cdr(pattern);
+        form = cdr(form);
+    }
+    if (pattern->type == SYMBOL_TYPE) {
+        if (isSymbolNamed(pattern, "_")) {
+            return 1;
+        }
+        if (inSymbolList(pattern->s, macro->literals)) {
+            return form->type == SYMBOL_TYPE && sameName(form->s, pattern->s);
+        }
+        *matches = addMatch(*matches, pattern->s, 0, form);
+        return 1;
+    }
+    if (pattern->type == NULL_TYPE) {
+        return form->type == NULL_TYPE;
+    }
+    return isEqual(pattern, form);
+}
+
+/* Templates */
+
+// Adds a renaming to matches for name, unless it already has one or is a
+// pattern variable. The new name starts with #, which the reader never
+// gives a symbol, so it can't capture a name the user wrote.
+Match *renameBinder(Value *name, Match *matches) {
+    if (name->type != SYMBOL_TYPE || isEllipsis(name) ||
+        findMatch(matches, name->s) != NULL) {
+        return matches;
+    }
+    MacroTable *table = &currentInterpreter()->macros;
+    char text[256];
+    int length = snprintf(text, sizeof(text), "#%.200s.%lu", name->s,
+                          ++table->renames);
+    Value *renamed = makeNull();
+    renamed->type = SYMBOL_TYPE;
+    renamed->s = internSymbol(text, length);
+    return addMatch(matches, name->s, -1, renamed);
+}
+
+// Adds renamings for the names bound by a let-style binding list.
+Match *renameBindings(Value *bindings, Match *matches) {
+    for (; bindings->type == CONS_TYPE; bindings = cdr(bindings)) {
+        if (car(bindings)->type == CONS_TYPE) {
+            matches = renameBinder(car(car(bindings)), matches);
+        }
+    }
+    return matches;
+}
+
+// Adds renamings for the parameters of a lambda.
+Match *renameParameters(Value *params, Match *matches) {
+    for (; params->type == CONS_TYPE; params = cdr(params)) {
+        matches = renameBinder(car(params), matches);
+    }
+    return renameBinder(params, matches);
+}
+
+// Adds to variables the pattern variables in template that are under
+// ellipses, which a repetition of template steps through.
+Match *repeatedVariables(Value *template, Match *matches, Match *variables) {
+    if (template->type == SYMBOL_TYPE) {
+        Match *match = findMatch(matches, template->s);
+        if (match != NULL && match->depth > 0 &&
+            findMatch(variables, template->s) == NULL) {
+            variables = addMatch(variables, match->name, match->depth,
+                                 match->value);
+        }
+        return variables;
+    }
+    for (; template->type == CONS_TYPE; template = cdr(template)) {
+        variables = repeatedVariables(car(template), matches, variables);
+    }
+    return variables;
+}
+
+// Adds item to the end of the list ending at *last.
+void appendItem(Value *item, Value **list, Value **last) {
+    Value *cell = cons(item, makeNull());
+    if (*last == NULL) {
+        *list = cell;
+    } else {
+        (*last)->c.cdr = cell;
+    }
+    *last = cell;
+}
+
+Value *fillTemplate(Value *template, Match *matches, int quoted);
+
+// Fills in each repetition of item, appending them to the list ending at
+// *last.
+void fillRepeated(Value *item, Match *matches, int quoted, Value **list,
+                  Value **last) {
+    Match *variables = repeatedVariables(item, matches, NULL);
+    if (variables == NULL) {
+        evalError("no pattern variable to repeat before ... in template");
+    }
+    int count = length(variables->value);
+    for (Match *variable = variables->next; variable != NULL;
+         variable = variable->next) {
+        if (length(variable->value) != count) {
+            evalError("pattern variables repeated by ... differ in length");
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        //each variable stands for its next value, one depth down
+        Match *repetition = matches;
+        for (Match *variable = variables; variable != NULL;
+             variable = variable->next) {
+            repetition = addMatch(repetition, variable->name,
+                                  variable->depth - 1, car(variable->value));
+            variable->value = cdr(variable->value);
+        }
+        appendItem(fillTemplate(item, repetition, quoted), list, last);
+    }
+}
+
+// Fills in the items of the list template, and its final cdr.
+Value *fillList(Value *template, Match *matches, int quoted) {
+    Value *list = makeNull();
+    Value *last = NULL;
+    while (template->type == CONS_TYPE) {
+        if (cdr(template)->type == CONS_TYPE && isEllipsis(car(cdr(template)))) {
+            fillRepeated(car(template), matches, quoted, &list, &last);
+            template = cdr(cdr(template));
+            continue;
+        }
+        appendItem(fillTemplate(car(template), matches, quoted), &list,
+                   &last);
+        template = cdr(template);
+    }
+    if (template->type != NULL_TYPE) {
+        Value *rest = fillTemplate(template, matches, quoted);
+        if (last == NULL) {
+            return rest;
+        }
+        last->c.cdr = rest;
+    }
+    return list;
+}
+
+// How the initial values of a binding list in a template see its names.
+enum { OUTER_INITS, SEQUENTIAL_INITS, DO_INITS };
+
+/*
+* Fills in a let-style binding list. Each name is filled with inner, which
+* has the renamings of the binders, and its initial value with outer, or
+* for let* with outer and the names before it; a do step is filled with
+* inner. Bindings repeated by ... name pattern variables, which aren't
+* renamed, so they are filled with outer.
+*/
+Value *fillBindings(Value *bindings, Match *outer, Match *inner, int inits) {
+    Value *list = makeNull();
+    Value *last = NULL;
+    Match *scope = outer;
+    while (bindings->type == CONS_TYPE) {
+        Value *binding = car(bindings);
+        if (cdr(bindings)->type == CONS_TYPE && isEllipsis(car(cdr(bindings)))) {
+            fillRepeated(binding, outer, 0, &list, &last);
+            bindings = cdr(cdr(bindings));
+            continue;
+        }
+        if (binding->type != CONS_TYPE || cdr(binding)->type != CONS_TYPE) {
+            appendItem(fillTemplate(binding, inner, 0), &list, &last);
+        } else {
+            Value *rest = cdr(binding);
+            Value *steps = fillList(cdr(rest), inits == DO_INITS ? inner
+                                                                 : scope, 0);
+            appendItem(cons(fillTemplate(car(binding), inner, 0),
+                            cons(fillTemplate(car(rest), scope, 0), steps)),
+                       &list, &last);
+        }
+        Match *renamed = binding->type == CONS_TYPE &&
+                         car(binding)->type == SYMBOL_TYPE
+                             ? findMatch(inner, car(binding)->s) : NULL;
+        if (inits == SEQUENTIAL_INITS && renamed != NULL &&
+            renamed->depth < 0) {
+            scope = addMatch(scope, renamed->name, -1, renamed->value);
+        }
+        bindings = cdr(bindings);
+    }
+    if (bindings->type != NULL_TYPE) {
+        Value *rest = fillTemplate(bindings, outer, 0);
+        if (last == NULL) {
+            return rest;
+        }
+        last->c.cdr = rest;
+    }
+    return list;
+}
+
+/*
+* Fills in a binding form: the names it binds are renamed in the parts of
+* it they are visible in, and nowhere else, so the template's other uses
+* of those names keep meaning what they meant where the macro was defined.
+* Returns NULL if template isn't a binding form.
+*/
+Value *fillBindingForm(Value *template, Match *matches) {
+    Value *head = car(template);
+    if (cdr(template)->type != CONS_TYPE) {
+        return NULL;
+    }
+    Value *second = car(cdr(template));
+    Value *body = cdr(cdr(template));
+    if (isSymbolNamed(head, "lambda")) {
+        return fillList(template, renameParameters(second, matches), 0);
+    } else if (isSymbolNamed(head, "letrec")) {
+        return fillList(template, renameBindings(second, matches), 0);
+    } else if (isSymbolNamed(head, "let") && second->type == SYMBOL_TYPE &&
+               body->type == CONS_TYPE) {
+        //a named let's name is bound in its body only
+        Value *bindings = car(body);
+        Match *inner = renameBinder(second,
+                                    renameBindings(bindings, matches));
+        return cons(head,
+                    cons(fillTemplate(second, inner, 0),
+                         cons(fillBindings(bindings, matches, inner,
+                                           OUTER_INITS),
+                              fillList(cdr(body), inner, 0))));
+    } else if (isSymbolNamed(head, "let") || isSymbolNamed(head, "let*") ||
+               isSymbolNamed(head, "do")) {
+        int inits = isSymbolNamed(head, "let*") ? SEQUENTIAL_INITS
+                    : isSymbolNamed(head, "do") ? DO_INITS
+                    : OUTER_INITS;
+        Match *inner = renameBindings(second, matches);
+        return cons(head, cons(fillBindings(second, matches, inner, inits),
+                               fillList(body, inner, 0)));
+    }
+    return NULL;
+}
+
+/*
+* Builds a copy of template with pattern variables replaced by what they
+* matched and renamed binders by their new names. Quoted parts keep their
+* original names.
+*/
+Value *fillTemplate(Value *template, Match *matches, int quoted) {
+    if (template->type == SYMBOL_TYPE) {
+        Match *match = findMatch(matches, template->s);
+        if (match == NULL || (match->depth < 0 && quoted)) {
+            return template;
+        }
+        if (match->depth > 0) {
+            evalError("pattern variable used without ... in template");
+        }
+        return match->value;
+    }
+    if (template->type != CONS_TYPE) {
+        return template;
+    }
+    if (isEllipsis(car(template)) && cdr(template)->type == CONS_TYPE) {
+        //(... template) stands for template with ... taken literally
+        return car(cdr(template));
+    }
+    quoted = quoted || isSymbolNamed(car(template), "quote");
+    if (!quoted) {
+        Value *filled = fillBindingForm(template, matches);
+        if (filled != NULL) {
+            return filled;
+        }
+    }
+    return fillList(template, matches, quoted);
+}
+
+// Returns the expansion of a use of macro by the first rule that matches.
+Value *expandUse(Macro *macro, Value *form) {
+    for (Value *rules = macro->rules; rules->type != NULL_TYPE;
+         rules = cdr(rules)) {
+        Value *pattern = car(car(rules));
+        Value *template = car(cdr(car(rules)));
+        Match *matches = NULL;
+        //the keyword in the pattern's first position isn't matched
+        if (matchPattern(cdr(pattern), cdr(form), macro, &matches)) {
+            return fillTemplate(template, matches, 0);
+        }
+    }
+    evalError("no syntax-rules pattern matches this use of macro");
+    return NULL;
+}
+
+/* The expansion pass */
+
+// Expansion never changes the forms it is given: a form with a macro use in
+// it is rebuilt around the expansion, sharing whatever parts didn't change,
+// since the same form may also be quoted data or appear elsewhere.
+
+// Returns list with its tail from cell on replaced by rest, copying the
+// cells before cell, or list itself if rest is that tail.
+Value *withTail(Value *list, Value *cell, Value *rest) {
+    if (rest == cell) {
+        return list;
+    } else if (list == cell) {
+        return rest;
+    }
+    return cons(car(list), withTail(cdr(list), cell, rest));
+}
+
+// Returns cell if it already holds first and rest, or a new cell that does.
+Value *withParts(Value *cell, Value *first, Value *rest) {
+    if (car(cell) == first && cdr(cell) == rest) {
+        return cell;
+    }
+    return cons(first, rest);
+}
+
+/*
+* The scope a form is expanded in is a list, innermost first, of the names
+* bound around it, and of the macros define-syntax forms in enclosing
+* bodies define, as pointers. A top-level scope is empty; the scope inside
+* any body has at least bodyMarker in it, so define-syntax there defines a
+* macro local to the body instead of a global one.
+*/
+Value bodyMarker = {.type = NULL_TYPE};
+
+// The macro a use of name refers to in scope: the innermost local one, or
+// none if a variable of that name is bound inside it, or the global one.
+Macro *scopedMacro(char *name, Value *scope) {
+    for (; scope->type == CONS_TYPE; scope = cdr(scope)) {
+        Value *entry = car(scope);
+        if (entry->type == SYMBOL_TYPE && sameName(entry->s, name)) {
+            return NULL;
+        } else if (entry->type == PTR_TYPE &&
+                   sameName(((Macro *)entry->p)->name, name)) {
+            return entry->p;
+        }
+    }
+    return findMacro(name);
+}
+
+// Adds the macros that define-syntax forms among forms define to scope, if
+// it is the scope of a body, so that they are in force throughout it.
+Value *scopeSyntax(Value *forms, Value *scope) {
+    if (scope->type != CONS_TYPE) {
+        return scope;
+    }
+    for (; forms->type == CONS_TYPE; forms = cdr(forms)) {
+        Value *form = car(forms);
+        if (form->type == CONS_TYPE &&
+            isSymbolNamed(car(form), "define-syntax")) {
+            Value *entry = makeNull();
+            entry->type = PTR_TYPE;
+            entry->p = parseSyntax(cdr(form));
+            scope = cons(entry, scope);
+        }
+    }
+    return scope;
+}
+
+Value *expandIn(Value *form, Value *scope);
+
+// Expands each form of a list, such as a body, in scope and with the
+// macros the list defines. Cells are only copied from the first one whose
+// form changed, so long argument lists cost nothing when nothing does.
+Value *expandEach(Value *forms, Value *scope) {
+    scope = scopeSyntax(forms, scope);
+    Value *result = forms;
+    Value *last = NULL;
+    Value *uncopied = forms;
+    for (Value *rest = forms; rest->type == CONS_TYPE; rest = cdr(rest)) {
+        Value *expanded = expandIn(car(rest), scope);
+        if (expanded == car(rest)) {
+            continue;
+        }
+        for (; uncopied != cdr(rest); uncopied = cdr(uncopied)) {
+            Value *cell = cons(uncopied == rest ? expanded : car(uncopied),
+                               makeNull());
+            if (last == NULL) {
+                result = cell;
+            } else {
+                last->c.cdr = cell;
+            }
+            last = cell;
+        }
+    }
+    if (last != NULL) {
+        last->c.cdr = uncopied;
+    }
+    return result;
+}
+
+/*
+* Expands the initial values of a let-style binding list in scope outer and
+* returns the expanded list, adding the names it binds to *inner.
+*/
+Value *expandBindings(Value *bindings, Value *outer, Value **inner) {
+    if (bindings->type != CONS_TYPE) {
+        return bindings;
+    }
+    Value *binding = car(bindings);
+    if (binding->type == CONS_TYPE) {
+        *inner = cons(car(binding), *inner);
+        binding = withTail(binding, cdr(binding),
+                           expandEach(cdr(binding), outer));
+    }
+    return withParts(bindings, binding,
+                     expandBindings(cdr(bindings), outer, inner));
+}
+
+// Expands the bindings of a do loop: each initial value in outer, each step
+// in inner, where the loop variables are bound.
+Value *expandDoBindings(Value *bindings, Value *outer, Value *inner) {
+    if (bindings->type != CONS_TYPE) {
+        return bindings;
+    }
+    Value *binding = car(bindings);
+    if (binding->type == CONS_TYPE && cdr(binding)->type == CONS_TYPE) {
+        Value *init = expandIn(car(cdr(binding)), outer);
+        Value *steps = expandEach(cdr(cdr(binding)), inner);
+        binding = withTail(binding, cdr(binding),
+                           withParts(cdr(binding), init, steps));
+    }
+    return withParts(bindings, binding,
+                     expandDoBindings(cdr(bindings), outer, inner));
+}
+
+/*
+* Returns form with the macro uses in it expanded, where scope lists what is
+* bound around it. A name bound as a variable is called, whatever macro
+* shares its name.
+*/
+Value *expandIn(Value *form, Value *scope) {
+    int expansions = 0;
+    while (form->type == CONS_TYPE) {
+        Value *head = car(form);
+        if (head->type != SYMBOL_TYPE) {
+            return expandEach(form, scope);
+        }
+        Macro *macro = scopedMacro(head->s, scope);
+        if (macro != NULL) {
+            if (++expansions > MAX_EXPANSIONS) {
+                evalError("macro expansion does not terminate");
+            }
+            form = expandUse(macro, form);
+            continue;
+        }
+        Value *args = cdr(form);
+        if (!strcmp(head->s, "quote")) {
+            return form;
+        } else if (!strcmp(head->s, "define-syntax")) {
+            //a body's macros were added to its scope before it was expanded
+            if (scope->type != CONS_TYPE) {
+                Macro *defined = parseSyntax(args);
+                addMacro(defined->name, defined->literals, defined->rules);
+            }
+            return form;
+        } else if (!strcmp(head->s, "lambda") && args->type == CONS_TYPE) {
+            Value *params = car(args);
+            Value *inner = cons(&bodyMarker, scope);
+            for (; params->type == CONS_TYPE; params = cdr(params)) {
+                inner = cons(car(params), inner);
+            }
+            if (params->type == SYMBOL_TYPE) {
+                inner = cons(params, inner);
+            }
+            return withTail(form, cdr(args), expandEach(cdr(args), inner));
+        } else if (!strcmp(head->s, "let") && args->type == CONS_TYPE &&
+                   car(args)->type == SYMBOL_TYPE &&
+                   cdr(args)->type == CONS_TYPE) {
+            //named let: the name is bound in the body along with the variables
+            Value *inner = cons(car(args), cons(&bodyMarker, scope));
+            Value *bindings = expandBindings(car(cdr(args)), scope, &inner);
+            Value *body = expandEach(cdr(cdr(args)), inner);
+            return withTail(form, cdr(args),
+                            withParts(cdr(args), bindings, body));
+        } else if ((!strcmp(head->s, "let") || !strcmp(head->s, "let*") ||
+                    !strcmp(head->s, "letrec")) && args->type == CONS_TYPE) {
+            Value *inner = cons(&bodyMarker, scope);
+            Value *bindings = expandBindings(car(args), scope, &inner);
+            Value *body = expandEach(cdr(args), inner);
+            return withTail(form, args, withParts(args, bindings, body));
+        } else if (!strcmp(head->s, "do") && args->type == CONS_TYPE) {
+            //steps, test and body all see the loop variables
+            Value *inner = cons(&bodyMarker, scope);
+            for (Value *bindings = car(args); bindings->type == CONS_TYPE;
+                 bindings = cdr(bindings)) {
+                if (car(bindings)->type == CONS_TYPE) {
+                    inner = cons(car(car(bindings)), inner);
+                }
+            }
+            Value *bindings = expandDoBindings(car(args), scope, inner);
+            Value *body = expandEach(cdr(args), inner);
+            return withTail(form, args, withParts(args, bindings, body));
+        }
+        return withTail(form, args, expandEach(args, scope));
+    }
+    return form;
+}
+
+Value *expandMacros(Value *form) {
+    return expandIn(form, makeNull());
+}
@@ -0,0 +1,34 @@
+#include "value.h"
+
+#ifndef _MACRO
+#define _MACRO
+
+// The syntax-rules macros an instance has defined, by name, and a count
+// used to make the names of renamed binders unique.
+typedef struct MacroTable {
+    struct Macro *macros;
+    unsigned long renames;
+} MacroTable;
+
+// Returns the top-level form with every macro use in it expanded, and
+// records the macros that define-syntax forms at top level define. form
+// itself is left as it was; the result shares the parts of it that had no
+// uses in them. Quoted data and names bound by an enclosing lambda, let or
+// do aren't treated as macro uses. A define-syntax inside a body defines a
+// macro for that body only.
+//
+// Hygiene is partial: names a template binds are renamed, within the part
+// of the template where the binding is visible, to names the reader can't
+// produce, so they can't capture the user's variables; but a free name in a template, like list
+// in (list a b), means whatever that name is bound to where the macro is
+// used, so a use inside a binding of list sees that binding.
+Value *expandMacros(Value *form);
+
+// The instance's macros as a list of (name literals rule ...), oldest first,
+// for a heap image to save.
+Value *macroDefinitions();
+
+// Records the macros of a list made by macroDefinitions.
+void defineMacros(Value *definitions);
+
+#endif
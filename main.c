@@ -1,17 +1,132 @@
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "tokenizer.h"
 #include "value.h"
 #include "linkedlist.h"
 #include "parser.h"
 #include "talloc.h"
 #include "interpreter.h"
+#include "output.h"
+#include "image.h"
+#include "server.h"
+#include "batch.h"
+#include "profiler.h"
+#include "metrics.h"
+
+// Reads, evaluates and prints one top-level datum at a time from stdin, so
+// results are printed as soon as each form is complete.
+void interpretStdin(Frame *globalFrame) {
+    Value *expr = readDatum();
+    while (expr != NULL) {
+        interpretExpr(expr, globalFrame);
+        expr = readDatum();
+    }
+}
+
+// Appends the main thread's allocation counts to the file named by
+// $SCHEME_TALLOC_STATS, one line of name=value fields.
+void writeTallocStats() {
+    FILE *file = fopen(getenv("SCHEME_TALLOC_STATS"), "a");
+    if (file == NULL) {
+        return;
+    }
+    TallocStats stats = tallocStats();
+    fprintf(file, "calls=%zu bytes=%zu blocks=%zu\n", stats.calls,
+            stats.bytes, stats.blocks);
+    fclose(file);
+}
+
+// Usage: interpreter [options] [file ...]
+// Each file is evaluated in turn in the same global frame, as if they had
+// been concatenated; "-" stands for stdin. With no files, stdin is read.
+// With $SCHEME_TALLOC_STATS set, allocation counts are written to that file
+// on exit. $SCHEME_MAX_DEPTH caps how deeply evaluation may recurse; by
+// default only memory does.
+// Options:
+//   --image file       start from a saved heap image instead of a fresh
+//                      global frame
+//   --save-image file  write a heap image once everything has been evaluated
+//   --server socket    after evaluating the files, serve programs on a Unix
+//                      domain socket instead of reading stdin
+//   --batch dir        after evaluating the files, run every .scm file in dir
+//                      as a separate script, in parallel
+//   --profile file     sample where time goes in Scheme procedures and write
+//                      collapsed stacks to file on exit
+//   --workers n        number of server workers or batch scripts run at
+//                      once (default 4)
+//   --recycle n        replace each server worker after n programs (default
+//                      0, never)
+//   --connect socket   send stdin to a server and print its reply
+int main(int argc, char **argv) {
 
-int main() {
+    START_METRICS();
+    if (getenv("SCHEME_TALLOC_STATS") != NULL) {
+        atexit(writeTallocStats);
+    }
+    char *imagePath = NULL;
+    char *saveImagePath = NULL;
+    char *serverPath = NULL;
+    char *batchPath = NULL;
+    int workers = 4;
+    int recycleAfter = 0;
+    int firstFile = 1;
+    while (firstFile + 1 < argc && !strncmp(argv[firstFile], "--", 2)) {
+        char *option = argv[firstFile];
+        char *argument = argv[firstFile + 1];
+        if (!strcmp(option, "--image")) {
+            imagePath = argument;
+        } else if (!strcmp(option, "--save-image")) {
+            saveImagePath = argument;
+        } else if (!strcmp(option, "--server")) {
+            serverPath = argument;
+        } else if (!strcmp(option, "--batch")) {
+            batchPath = argument;
+        } else if (!strcmp(option, "--profile")) {
+            startProfiler(argument);
+        } else if (!strcmp(option, "--workers")) {
+            workers = atoi(argument);
+        } else if (!strcmp(option, "--recycle")) {
+            recycleAfter = atoi(argument);
+        } else if (!strcmp(option, "--connect")) {
+            return runClient(argument);
+        } else {
+            fprintf(stderr, "unknown option %s\n", option);
+            return 1;
+        }
+        firstFile += 2;
+    }
 
-    Value *list = tokenize();
-    Value *tree = parse(list);
-    interpret(tree);
+    Interpreter *interp = newInterpreter();
+    Frame *globalFrame = interp->globalFrame;
+    if (imagePath != NULL) {
+        globalFrame = loadImage(imagePath);
+    }
+    if (firstFile == argc && saveImagePath == NULL && serverPath == NULL &&
+        batchPath == NULL) {
+        interpretStdin(globalFrame);
+    }
+    for (int i = firstFile; i < argc; i++) {
+        if (!strcmp(argv[i], "-")) {
+            interpretStdin(globalFrame);
+        } else {
+            loadFile(argv[i], globalFrame, 1);
+        }
+    }
+    if (saveImagePath != NULL) {
+        saveImage(saveImagePath, globalFrame);
+    }
+    int status = 0;
+    if (batchPath != NULL && runBatch(batchPath, globalFrame, workers) > 0) {
+        status = 1;
+    }
+    if (serverPath != NULL) {
+        runServer(serverPath, globalFrame, workers, recycleAfter);
+    }
 
+    outFlush();
+    freeInterpreter(interp);
     tfree();
-    return 0;
+    return status;
 }
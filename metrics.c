@@ -0,0 +1,141 @@
+/* Export of the interpreter's runtime counters, compiled in only with
+ * -DSCHEME_METRICS. */
+#include "metrics.h"
+
+#ifdef SCHEME_METRICS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "talloc.h"
+
+Metrics metrics;
+volatile int metricsRequested = 0;
+char *metricsPath = NULL;
+int metricsAsJson = 0;
+
+char *formNames[FORM_COUNT] = {
+    "if", "let", "quote", "define", "lambda", "let*", "letrec", "set!",
+    "begin", "and", "or", "cond", "do", "delay", "application"
+};
+
+void requestMetrics(int signal) {
+    metricsRequested = 1;
+}
+
+void registerPrimitiveMetric(char *name, Value *(*function)(Value *)) {
+    for (int i = 0; i < metrics.primitiveCount; i++) {
+        if (metrics.primitives[i] == function) {
+            return;
+        }
+    }
+    if (metrics.primitiveCount < MAX_PRIMITIVE_METRICS) {
+        metrics.primitiveNames[metrics.primitiveCount] = name;
+        metrics.primitives[metrics.primitiveCount] = function;
+        metrics.primitiveCount++;
+    }
+}
+
+void countPrimitiveCall(Value *(*function)(Value *)) {
+    for (int i = 0; i < metrics.primitiveCount; i++) {
+        if (metrics.primitives[i] == function) {
+            metrics.primitiveCalls[i]++;
+            return;
+        }
+    }
+}
+
+double averageChain() {
+    return metrics.lookups ? (double)metrics.lookupSteps / metrics.lookups
+                           : 0;
+}
+
+void writePrometheus(FILE *file) {
+    TallocStats stats = tallocStats();
+    fprintf(file, "# TYPE scheme_forms_total counter\n");
+    for (int i = 0; i < FORM_COUNT; i++) {
+        fprintf(file, "scheme_forms_total{form=\"%s\"} %zu\n", formNames[i],
+                metrics.forms[i]);
+    }
+    fprintf(file, "# TYPE scheme_primitive_calls_total counter\n");
+    for (int i = 0; i < metrics.primitiveCount; i++) {
+        fprintf(file, "scheme_primitive_calls_total{primitive=\"%s\"} %zu\n",
+                metrics.primitiveNames[i], metrics.primitiveCalls[i]);
+    }
+    fprintf(file, "# TYPE scheme_closure_applications_total counter\n");
+    fprintf(file, "scheme_closure_applications_total %zu\n",
+            metrics.closureApplications);
+    fprintf(file, "# TYPE scheme_frames_allocated_total counter\n");
+    fprintf(file, "scheme_frames_allocated_total %zu\n",
+            metrics.framesAllocated);
+    fprintf(file, "# TYPE scheme_lookups_total counter\n");
+    fprintf(file, "scheme_lookups_total %zu\n", metrics.lookups);
+    fprintf(file, "# TYPE scheme_lookup_steps_total counter\n");
+    fprintf(file, "scheme_lookup_steps_total %zu\n", metrics.lookupSteps);
+    fprintf(file, "# TYPE scheme_lookup_chain_average gauge\n");
+    fprintf(file, "scheme_lookup_chain_average %.3f\n", averageChain());
+    fprintf(file, "# TYPE scheme_allocated_bytes_total counter\n");
+    fprintf(file, "scheme_allocated_bytes_total %zu\n", stats.bytes);
+    fprintf(file, "# TYPE scheme_allocations_total counter\n");
+    fprintf(file, "scheme_allocations_total %zu\n", stats.calls);
+}
+
+void writeJson(FILE *file) {
+    TallocStats stats = tallocStats();
+    fprintf(file, "{\"forms\": {");
+    for (int i = 0; i < FORM_COUNT; i++) {
+        fprintf(file, "%s\"%s\": %zu", i ? ", " : "", formNames[i],
+                metrics.forms[i]);
+    }
+    fprintf(file, "}, \"primitive_calls\": {");
+    for (int i = 0; i < metrics.primitiveCount; i++) {
+        fprintf(file, "%s\"%s\": %zu", i ? ", " : "",
+                metrics.primitiveNames[i], metrics.primitiveCalls[i]);
+    }
+    fprintf(file, "}, \"closure_applications\": %zu, "
+                  "\"frames_allocated\": %zu, \"lookups\": %zu, "
+                  "\"lookup_steps\": %zu, \"lookup_chain_average\": %.3f, "
+                  "\"allocated_bytes\": %zu, \"allocations\": %zu}\n",
+            metrics.closureApplications, metrics.framesAllocated,
+            metrics.lookups, metrics.lookupSteps, averageChain(),
+            stats.bytes, stats.calls);
+}
+
+void exportMetrics() {
+    metricsRequested = 0;
+    FILE *file = stderr;
+    if (strcmp(metricsPath, "-") != 0) {
+        file = fopen(metricsPath, "w");
+        if (file == NULL) {
+            return;
+        }
+    }
+    if (metricsAsJson) {
+        writeJson(file);
+    } else {
+        writePrometheus(file);
+    }
+    if (file == stderr) {
+        fflush(file);
+    } else {
+        fclose(file);
+    }
+}
+
+void startMetrics() {
+    metricsPath = getenv("SCHEME_METRICS");
+    if (metricsPath == NULL) {
+        return;
+    }
+    char *format = getenv("SCHEME_METRICS_FORMAT");
+    metricsAsJson = format != NULL && !strcmp(format, "json");
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = requestMetrics;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+    atexit(exportMetrics);
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include <stddef.h>
+#include "value.h"
+
+#ifndef _METRICS
+#define _METRICS
+
+// Counters of what the interpreter does: special forms dispatched by eval,
+// calls to each primitive, closure applications, frames allocated, the
+// bindings getBoundValue walks past, and talloc's allocations. They are
+// compiled in only with -DSCHEME_METRICS (make METRICS=yes); otherwise every
+// macro here expands to nothing. Counts are exported when the program exits
+// and whenever the process gets SIGUSR1, to the file named by
+// $SCHEME_METRICS ("-" for stderr), as Prometheus text, or as JSON if
+// $SCHEME_METRICS_FORMAT is "json". Counts made on future workers may be
+// lost to races, since the counters aren't atomic.
+
+// What eval dispatched on.
+typedef enum {
+    FORM_IF, FORM_LET, FORM_QUOTE, FORM_DEFINE, FORM_LAMBDA, FORM_LET_STAR,
+    FORM_LETREC, FORM_SET, FORM_BEGIN, FORM_AND, FORM_OR, FORM_COND,
+    FORM_DO, FORM_DELAY, FORM_APPLICATION, FORM_COUNT
+} FormKind;
+
+#ifdef SCHEME_METRICS
+
+#define MAX_PRIMITIVE_METRICS 64
+
+typedef struct Metrics {
+    size_t forms[FORM_COUNT];
+    size_t closureApplications;
+    size_t framesAllocated;
+    size_t lookups;
+    size_t lookupSteps;
+    int primitiveCount;
+    char *primitiveNames[MAX_PRIMITIVE_METRICS];
+    Value *(*primitives[MAX_PRIMITIVE_METRICS])(Value *);
+    size_t primitiveCalls[MAX_PRIMITIVE_METRICS];
+} Metrics;
+
+extern Metrics metrics;
+
+// Set by SIGUSR1; the counters are exported at the next safe point.
+extern volatile int metricsRequested;
+
+// Reads the environment, installs the SIGUSR1 handler and arranges for the
+// counters to be exported on exit.
+void startMetrics();
+
+// Notes that function is the primitive bound to name.
+void registerPrimitiveMetric(char *name, Value *(*function)(Value *));
+
+// Counts a call to the primitive function.
+void countPrimitiveCall(Value *(*function)(Value *));
+
+// Writes the counters out now.
+void exportMetrics();
+
+#define START_METRICS() startMetrics()
+#define COUNT_FORM(kind) (metrics.forms[kind]++)
+#define COUNT_CLOSURE_APPLICATION() (metrics.closureApplications++)
+#define COUNT_FRAME() (metrics.framesAllocated++)
+#define COUNT_LOOKUP() (metrics.lookups++)
+#define COUNT_LOOKUP_STEP() (metrics.lookupSteps++)
+#define REGISTER_PRIMITIVE(name, function) \
+    registerPrimitiveMetric(name, function)
+#define COUNT_PRIMITIVE_CALL(function) countPrimitiveCall(function)
+#define METRICS_SAFE_POINT()                                              \
+    do {                                                                  \
+        if (metricsRequested) {                                           \
+            exportMetrics();                                              \
+        }                                                                 \
+    } while (0)
+
+#else
+
+#define START_METRICS()
+#define COUNT_FORM(kind)
+#define COUNT_CLOSURE_APPLICATION()
+#define COUNT_FRAME()
+#define COUNT_LOOKUP()
+#define COUNT_LOOKUP_STEP()
+#define REGISTER_PRIMITIVE(name, function)
+#define COUNT_PRIMITIVE_CALL(function)
+#define METRICS_SAFE_POINT()
+
+#endif
+
+#endif
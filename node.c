@@ -0,0 +1,326 @@
+/* Application nodes that specialize themselves on the types they see. */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "node.h"
+#include "interpreter.h"
+#include "linkedlist.h"
+#include "metrics.h"
+#include "talloc.h"
+
+// Guard failures after which a node stops specializing.
+#define MAX_DEOPTS 3
+// Closure calls with more arguments than this are left generic.
+#define MAX_NODE_ARGUMENTS 8
+
+// One generation of the table's slots. Growing makes a new generation and
+// keeps the old ones, which a lookup may still be reading, until the table
+// is freed.
+typedef struct NodeSlots {
+    size_t capacity;
+    size_t count;
+    struct NodeSlots *older;
+    struct NodeEntry {
+        _Atomic(Value *) form;
+        _Atomic(Node *) node;
+    } entries[];
+} NodeSlots;
+
+void initNodeTable(NodeTable *table) {
+    atomic_init(&table->slots, NULL);
+    pthread_mutex_init(&table->lock, NULL);
+}
+
+void freeNodeTable(NodeTable *table) {
+    NodeSlots *slots = atomic_load(&table->slots);
+    while (slots != NULL) {
+        NodeSlots *older = slots->older;
+        free(slots);
+        slots = older;
+    }
+    pthread_mutex_destroy(&table->lock);
+}
+
+size_t hashApplication(Value *form, size_t capacity) {
+    uint64_t key = (uint64_t)(uintptr_t)form;
+    key = (key ^ (key >> 33)) * 0xff51afd7ed558ccdull;
+    return (key ^ (key >> 33)) & (capacity - 1);
+}
+
+// Returns where form's entry is or would go in slots.
+size_t findApplication(NodeSlots *slots, Value *form) {
+    size_t slot = hashApplication(form, slots->capacity);
+    while (1) {
+        Value *key = atomic_load_explicit(&slots->entries[slot].form,
+                                          memory_order_acquire);
+        if (key == NULL || key == form) {
+            return slot;
+        }
+        slot = (slot + 1) & (slots->capacity - 1);
+    }
+}
+
+Node *knownApplication(Value *tree) {
+    NodeTable *table = &currentInterpreter()->nodes;
+    NodeSlots *slots = atomic_load_explicit(&table->slots,
+                                            memory_order_acquire);
+    if (slots == NULL) {
+        return NULL;
+    }
+    size_t slot = findApplication(slots, tree);
+    //an empty slot may have a node already, one being put in for another form
+    if (atomic_load_explicit(&slots->entries[slot].form,
+                             memory_order_acquire) != tree) {
+        return NULL;
+    }
+    return atomic_load_explicit(&slots->entries[slot].node,
+                                memory_order_acquire);
+}
+
+// Makes a generation of slots twice the size of the current one, holding
+// the same entries. Called with the lock held.
+NodeSlots *growNodeTable(NodeTable *table, NodeSlots *slots) {
+    size_t capacity = slots != NULL ? slots->capacity * 2 : 1024;
+    NodeSlots *grown = calloc(1, sizeof(NodeSlots) +
+                                 capacity * sizeof(struct NodeEntry));
+    if (grown == NULL) {
+        evalError("out of memory");
+    }
+    grown->capacity = capacity;
+    grown->older = slots;
+    for (size_t i = 0; slots != NULL && i < slots->capacity; i++) {
+        Value *form = atomic_load(&slots->entries[i].form);
+        if (form != NULL) {
+            size_t slot = findApplication(grown, form);
+            atomic_store(&grown->entries[slot].node,
+                         atomic_load(&slots->entries[i].node));
+            atomic_store(&grown->entries[slot].form, form);
+            grown->count++;
+        }
+    }
+    atomic_store_explicit(&table->slots, grown, memory_order_release);
+    return grown;
+}
+
+// Makes node the node of form, in place of any it had.
+void installNode(Value *form, Node *node) {
+    NodeTable *table = &currentInterpreter()->nodes;
+    pthread_mutex_lock(&table->lock);
+    NodeSlots *slots = atomic_load(&table->slots);
+    if (slots == NULL || (slots->count + 1) * 2 > slots->capacity) {
+        slots = growNodeTable(table, slots);
+    }
+    size_t slot = findApplication(slots, form);
+    //the node goes in first, so a lookup for this form that finds the form
+    //finds its node too; lookups for other forms check the form themselves
+    atomic_store_explicit(&slots->entries[slot].node, node,
+                          memory_order_release);
+    if (atomic_load(&slots->entries[slot].form) == NULL) {
+        atomic_store_explicit(&slots->entries[slot].form, form,
+                              memory_order_release);
+        slots->count++;
+    }
+    pthread_mutex_unlock(&table->lock);
+}
+
+// Which of the arithmetic and comparison primitives function is, as its
+// operator character, or 0 for any other function.
+char primitiveOperation(Value *function) {
+    Value *(*primFn)(Value *) = function->primFn;
+    if (primFn == primitiveAdd) {
+        return '+';
+    } else if (primFn == primitiveSubtract) {
+        return '-';
+    } else if (primFn == primitiveMultiply) {
+        return '*';
+    } else if (primFn == primitiveDivide) {
+        return '/';
+    } else if (primFn == primitiveLess) {
+        return '<';
+    } else if (primFn == primitiveGreater) {
+        return '>';
+    } else if (primFn == primitiveEqual) {
+        return '=';
+    }
+    return 0;
+}
+
+int isComparison(char operation) {
+    return operation == '<' || operation == '>' || operation == '=';
+}
+
+// Whether params is a proper list of exactly count names.
+int takesExactly(Value *params, int count) {
+    for (; params->type == CONS_TYPE; params = cdr(params)) {
+        if (count-- == 0) {
+            return 0;
+        }
+    }
+    return params->type == NULL_TYPE && count == 0;
+}
+
+/*
+* Records a node for tree, a call of function with the argument values just
+* seen, one that stays generic if deopts has reached MAX_DEOPTS.
+*/
+void specialize(Value *tree, Value *function, Value *values, int deopts) {
+    Node *node = talloc(sizeof(Node));
+    node->kind = NODE_GENERIC;
+    node->operation = 0;
+    node->deopts = deopts;
+    node->primFn = NULL;
+    int count = length(values);
+    if (deopts >= MAX_DEOPTS) {
+        //failed its guards too often to be worth specializing again
+    } else if (function->type == PRIMITIVE_TYPE && count == 2) {
+        char operation = primitiveOperation(function);
+        valueType first = car(values)->type;
+        valueType second = car(cdr(values))->type;
+        node->operation = operation;
+        node->primFn = function->primFn;
+        if (operation == 0 || first != second) {
+            node->kind = NODE_GENERIC;
+        } else if (first == INT_TYPE && operation != '/') {
+            //int division can give a double, so it stays generic
+            node->kind = isComparison(operation) ? NODE_INT_COMPARISON
+                                                 : NODE_INT_ARITHMETIC;
+        } else if (first == DOUBLE_TYPE) {
+            node->kind = isComparison(operation) ? NODE_DOUBLE_COMPARISON
+                                                 : NODE_DOUBLE_ARITHMETIC;
+        }
+    } else if (function->type == CLOSURE_TYPE &&
+               count <= MAX_NODE_ARGUMENTS &&
+               takesExactly(function->closure.paramNames, count)) {
+        node->kind = NODE_CLOSURE_CALL;
+    }
+    installNode(tree, node);
+}
+
+// Replaces the node of tree, whose guard has just failed, with one for the
+// call it failed on. The old node is left as it was, since another thread
+// may be running it.
+void deoptimize(Value *tree, Node *node, Value *function, Value *values) {
+    specialize(tree, function, values, node->deopts + 1);
+}
+
+/*
+* Applies a two-argument arithmetic or comparison node to first and
+* second, the way helpArithmetic and argToDouble would, or returns NULL
+* if they aren't the types the node is for.
+*/
+Value *applyBinaryNode(Node *node, Value *first, Value *second) {
+    Value *result;
+    switch (node->kind) {
+        case NODE_INT_ARITHMETIC:
+            if (first->type != INT_TYPE || second->type != INT_TYPE) {
+                return NULL;
+            }
+            result = makeNull();
+            result->type = INT_TYPE;
+            //computed in doubles, as the generic path does
+            result->i = node->operation == '+'
+                            ? (double)first->i + second->i
+                        : node->operation == '-'
+                            ? (double)first->i - second->i
+                            : (double)first->i * second->i;
+            return result;
+        case NODE_DOUBLE_ARITHMETIC:
+            if (first->type != DOUBLE_TYPE || second->type != DOUBLE_TYPE) {
+                return NULL;
+            }
+            result = makeNull();
+            result->type = DOUBLE_TYPE;
+            result->d = node->operation == '+' ? first->d + second->d
+                        : node->operation == '-' ? first->d - second->d
+                        : node->operation == '*' ? first->d * second->d
+                                                 : first->d / second->d;
+            return result;
+        case NODE_INT_COMPARISON:
+        case NODE_DOUBLE_COMPARISON: {
+            double a, b;
+            if (node->kind == NODE_INT_COMPARISON) {
+                if (first->type != INT_TYPE || second->type != INT_TYPE) {
+                    return NULL;
+                }
+                a = first->i;
+                b = second->i;
+            } else {
+                if (first->type != DOUBLE_TYPE ||
+                    second->type != DOUBLE_TYPE) {
+                    return NULL;
+                }
+                a = first->d;
+                b = second->d;
+            }
+            result = makeNull();
+            result->type = BOOL_TYPE;
+            result->i = node->operation == '<' ? a < b
+                        : node->operation == '>' ? a > b
+                                                 : a == b;
+            return result;
+        }
+        default:
+            return NULL;
+    }
+}
+
+// Runs a closure-call node on the evaluated arguments, or returns NULL if
+// function isn't a closure taking exactly that many.
+Value *applyClosureNode(Value *function, Value **values, int count) {
+    if (function->type != CLOSURE_TYPE ||
+        !takesExactly(function->closure.paramNames, count)) {
+        return NULL;
+    }
+    Frame *fnFrame = makeCallFrame(function);
+    //bound in the same order bindArgs uses
+    Value *params = function->closure.paramNames;
+    for (int i = 0; i < count; i++) {
+        fnFrame->bindings = cons(cons(car(params), values[i]),
+                                 fnFrame->bindings);
+        params = cdr(params);
+    }
+    return runClosure(function, fnFrame);
+}
+
+// Runs a specialized node. Arguments are evaluated before the operator,
+// as for any application, so a failed guard never evaluates them twice.
+Value *evalNode(Value *tree, Node *node, Frame *frame) {
+    Value *values[MAX_NODE_ARGUMENTS];
+    int count = 0;
+    for (Value *args = cdr(tree); args->type == CONS_TYPE; args = cdr(args)) {
+        values[count++] = eval(car(args), frame);
+    }
+    Value *function = eval(car(tree), frame);
+    METRICS_SAFE_POINT();
+    Value *result = NULL;
+    if (node->kind == NODE_CLOSURE_CALL) {
+        result = applyClosureNode(function, values, count);
+    } else if (function->type == PRIMITIVE_TYPE &&
+               function->primFn == node->primFn) {
+        result = applyBinaryNode(node, values[0], values[1]);
+        if (result != NULL) {
+            COUNT_PRIMITIVE_CALL(function->primFn);
+        }
+    }
+    if (result != NULL) {
+        return result;
+    }
+    Value *args = makeNull();
+    for (int i = count - 1; i >= 0; i--) {
+        args = cons(values[i], args);
+    }
+    deoptimize(tree, node, function, args);
+    return apply(function, args);
+}
+
+Value *evalApplication(Value *tree, Node *node, Frame *frame) {
+    if (node != NULL && node->kind != NODE_GENERIC) {
+        return evalNode(tree, node, frame);
+    }
+    Value *args = evalFnArgs(cdr(tree), frame);
+    Value *function = eval(car(tree), frame);
+    if (node == NULL) {
+        specialize(tree, function, args, 0);
+    }
+    return apply(function, args);
+}
@@ -0,0 +1,57 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include "value.h"
+
+#ifndef _NODE
+#define _NODE
+
+// Self-specializing application nodes. The first time eval runs an
+// application form it records a node for it in the instance's node table:
+// what the call turned out to be, arithmetic or a comparison on two ints or
+// two doubles, a call to a closure taking exactly the arguments given, or
+// anything else. Later runs of the form take the path for that case once a
+// guard has checked that the operator and the arguments are still what was
+// recorded. When a guard fails the node deoptimizes: the call is finished
+// the generic way and a fresh node for what it failed on takes the old
+// one's place, until after a few failures the replacement is generic for
+// good. The forms themselves are never changed, so code that is also
+// quoted data, or that a saved image holds, looks just as it was read.
+
+// What an application node has specialized on. A generic node takes the
+// ordinary path.
+typedef enum {
+    NODE_GENERIC, NODE_INT_ARITHMETIC, NODE_DOUBLE_ARITHMETIC,
+    NODE_INT_COMPARISON, NODE_DOUBLE_COMPARISON, NODE_CLOSURE_CALL
+} nodeKind;
+
+// For arithmetic and comparisons, the primitive the call was seen to make
+// and that primitive's operator character. A node isn't changed once it is
+// in the table; another replaces it.
+typedef struct Node {
+    unsigned char kind;
+    char operation;
+    unsigned short deopts;
+    Value *(*primFn)(Value *);
+} Node;
+
+// The nodes of the application forms an instance has run, keyed by form.
+// Futures run an instance's code on several threads, so lookups go without
+// a lock through slots that are only ever added to or replaced whole, and
+// changes take the lock.
+typedef struct NodeTable {
+    _Atomic(struct NodeSlots *) slots;
+    pthread_mutex_t lock;
+} NodeTable;
+
+void initNodeTable(NodeTable *table);
+void freeNodeTable(NodeTable *table);
+
+// The node of the application form tree, or NULL if it hasn't run yet.
+// Special forms never have one.
+Node *knownApplication(Value *tree);
+
+// Evaluates the application form tree in frame, with node, its node from
+// knownApplication, or NULL the first time it runs.
+Value *evalApplication(Value *tree, Node *node, Frame *frame);
+
+#endif
@@ -0,0 +1,186 @@
+/* Buffered output for the interpreter, with number formatting done by hand
+ * rather than through printf. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include "output.h"
+
+#define OUTPUT_SIZE 65536
+
+// Each thread buffers its own output, so worker threads can print without
+// locking; each flushes its buffer when it finishes a task.
+_Thread_local char outputBuffer[OUTPUT_SIZE];
+_Thread_local size_t outputLength = 0;
+_Thread_local int outputFd = 1;
+
+// Pairs of digits for 00 through 99, so integers are converted two digits at
+// a time.
+const char digitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Writes all of text to the output descriptor. If it can't be written, the
+// rest is dropped, since there is nowhere left to report the failure.
+void writeAll(const char *text, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t result = write(outputFd, text + written, length - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result <= 0) {
+            break;
+        }
+        written += result;
+    }
+}
+
+void outFlush() {
+    writeAll(outputBuffer, outputLength);
+    outputLength = 0;
+}
+
+void setOutputFd(int fd) {
+    outFlush();
+    outputFd = fd;
+}
+
+void outBytes(const char *text, size_t length) {
+    if (outputLength + length > OUTPUT_SIZE) {
+        outFlush();
+        if (length > OUTPUT_SIZE) {
+            //too big to buffer; write it straight through
+            writeAll(text, length);
+            return;
+        }
+    }
+    memcpy(outputBuffer + outputLength, text, length);
+    outputLength += length;
+}
+
+void outChar(char c) {
+    if (outputLength == OUTPUT_SIZE) {
+        outFlush();
+    }
+    outputBuffer[outputLength++] = c;
+}
+
+void outString(const char *text) {
+    outBytes(text, strlen(text));
+}
+
+// Writes the digits of number into the end of buffer, returning where they
+// start.
+char *formatUnsigned(unsigned long long number, char *end) {
+    char *start = end;
+    while (number >= 100) {
+        unsigned pair = (number % 100) * 2;
+        number /= 100;
+        start -= 2;
+        start[0] = digitPairs[pair];
+        start[1] = digitPairs[pair + 1];
+    }
+    if (number >= 10) {
+        start -= 2;
+        start[0] = digitPairs[number * 2];
+        start[1] = digitPairs[number * 2 + 1];
+    } else {
+        *--start = '0' + number;
+    }
+    return start;
+}
+
+void outInt(long number) {
+    char buffer[24];
+    char *end = buffer + sizeof(buffer);
+    unsigned long long magnitude = number < 0 ? 0ULL - (unsigned long long)number
+                                             : (unsigned long long)number;
+    char *start = formatUnsigned(magnitude, end);
+    if (number < 0) {
+        *--start = '-';
+    }
+    outBytes(start, end - start);
+}
+
+// Appends a double through snprintf, for the cases the hand-written paths
+// below don't cover.
+void outFormatted(const char *format, int precision, double number) {
+    char buffer[512];
+    int length = snprintf(buffer, sizeof(buffer), format, precision, number);
+    outBytes(buffer, length);
+}
+
+void outDouble(double number) {
+    double magnitude = fabs(number);
+    //past 2^52 the fraction is gone, and NaN and infinity need printf's
+    //spelling
+    if (!(magnitude < 4503599627370496.0)) {
+        outFormatted("%.*f", 6, number);
+        return;
+    }
+    unsigned long long whole = (unsigned long long)magnitude;
+    double scaled = (magnitude - whole) * 1e6;
+    double below = floor(scaled);
+    //the multiplication can round, so leave exact halves to printf, which
+    //rounds the true decimal value
+    if (fabs(scaled - below - 0.5) < 1e-6) {
+        outFormatted("%.*f", 6, number);
+        return;
+    }
+    unsigned long long fraction = (unsigned long long)(scaled - below < 0.5 ?
+                                                       below : below + 1);
+    if (fraction == 1000000) {
+        whole++;
+        fraction = 0;
+    }
+    char buffer[40];
+    char *end = buffer + sizeof(buffer);
+    char *start = end - 6;
+    for (int i = 5; i >= 0; i--) {
+        start[i] = '0' + fraction % 10;
+        fraction /= 10;
+    }
+    *--start = '.';
+    start = formatUnsigned(whole, start);
+    if (signbit(number)) {
+        *--start = '-';
+    }
+    outBytes(start, end - start);
+}
+
+void outDoubleShortest(double number) {
+    double magnitude = fabs(number);
+    if (magnitude < 1e15 && magnitude == floor(magnitude)) {
+        //whole numbers are the common case and need no searching
+        if (signbit(number)) {
+            outChar('-');
+        }
+        char buffer[24];
+        char *end = buffer + sizeof(buffer);
+        char *start = formatUnsigned((unsigned long long)magnitude, end);
+        outBytes(start, end - start);
+        outBytes(".0", 2);
+        return;
+    }
+    if (isnan(number) || isinf(number)) {
+        outString(isnan(number) ? "+nan.0" : number > 0 ? "+inf.0" : "-inf.0");
+        return;
+    }
+    //every double reads back exactly from 17 significant digits; take the
+    //fewest that do
+    char buffer[32];
+    int length = 0;
+    for (int precision = 15; precision <= 17; precision++) {
+        length = snprintf(buffer, sizeof(buffer), "%.*g", precision, number);
+        if (strtod(buffer, NULL) == number) {
+            break;
+        }
+    }
+    outBytes(buffer, length);
+    if (strpbrk(buffer, ".en") == NULL) {
+        outBytes(".0", 2);
+    }
+}
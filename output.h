@@ -0,0 +1,36 @@
+#include <stddef.h>
+
+#ifndef _OUTPUT
+#define _OUTPUT
+
+// Buffered output. Text is collected in a large buffer and written to the
+// output file descriptor in blocks, when the buffer fills, when outFlush is
+// called, or before the tokenizer blocks waiting for more input.
+
+// Make output on the calling thread go to the given file descriptor. Output
+// starts on stdout. Pending output is flushed to the old descriptor first.
+void setOutputFd(int fd);
+
+// Append a single character.
+void outChar(char c);
+
+// Append length bytes starting at text.
+void outBytes(const char *text, size_t length);
+
+// Append a null-terminated string.
+void outString(const char *text);
+
+// Append an integer in decimal.
+void outInt(long number);
+
+// Append a double with six digits after the point, the same as printf's %f.
+void outDouble(double number);
+
+// Append the shortest decimal form of a double that reads back as the same
+// value, always with a point or exponent so it reads as a double.
+void outDoubleShortest(double number);
+
+// Write everything buffered so far.
+void outFlush();
+
+#endif
@@ -2,80 +2,293 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "talloc.h"
 #include "linkedlist.h"
 #include "parser.h"
+#include "tokenizer.h"
+#include "output.h"
+#include "profiler.h"
 
 void syntaxError(const char *errorMessage) {
-    printf("%s", errorMessage);
-    texit(1);
+    outString(errorMessage);
+    outFlush();
+    abandonEvaluation();
 }
 
-Value *updateTree(Value *tree, int *depth, Value *token) {
-    if (token->type != CLOSE_TYPE) {
-        Value *temp = cons(token, tree);
-        tree = temp;
-        if (token->type == OPEN_TYPE) {
-            *depth = *depth + 1;
+// The reader pulls tokens one at a time from tokenSource, which is either the
+// tokenizer itself or a cursor over an already tokenized list.
+_Thread_local Value *(*tokenSource)() = nextToken;
+_Thread_local Value *tokenCursor = NULL;
+
+Value *nextListToken() {
+    if (tokenCursor->type == NULL_TYPE) {
+        return NULL;
+    }
+    Value *token = car(tokenCursor);
+    tokenCursor = cdr(tokenCursor);
+    return token;
+}
+
+Value *readFrom(Value *token);
+
+// Reads list items up to the close token matching closeType, building the
+// list front to back. Handles a dotted final cdr.
+Value *readList(valueType closeType) {
+    Value *list = makeNull();
+    Value *last = NULL;
+    Value *token = tokenSource();
+    while (token != NULL) {
+        if (token->type == CLOSE_TYPE || token->type == CLOSEBRACKET_TYPE) {
+            if (token->type != closeType) {
+                syntaxError("Syntax error: mismatched brackets");
+            }
+            return list;
+        } else if (token->type == DOT_TYPE) {
+            Value *rest = tokenSource();
+            if (last == NULL || rest == NULL || rest->type == closeType) {
+                syntaxError("Syntax error: bad dotted pair");
+            }
+            last->c.cdr = readFrom(rest);
+            token = tokenSource();
+            if (token == NULL || token->type != closeType) {
+                syntaxError("Syntax error: bad dotted pair");
+            }
+            return list;
         }
-    } else {
-        if (tree->type == NULL_TYPE || *depth < 1) {
-            syntaxError("Syntax error: too many close parentheses");
+        Value *item = cons(readFrom(token), makeNull());
+        if (last == NULL) {
+            list = item;
+        } else {
+            last->c.cdr = item;
         }
-        *depth = *depth - 1;
-        Value *subtree = makeNull();
-        while (car(tree)->type != OPEN_TYPE) {
-            Value *temp = cons(car(tree), subtree);
-            subtree = temp;
-            tree = cdr(tree);
-            if (tree->type == NULL_TYPE) {
-                syntaxError("Syntax error: too many close parentheses");
-            }
+        last = item;
+        token = tokenSource();
+    }
+    syntaxError("Syntax error: not enough close parentheses");
+    return NULL;
+}
+
+// Builds the datum that begins with token, reading further tokens as needed.
+Value *readFrom(Value *token) {
+    if (token->type == OPEN_TYPE || token->type == OPENBRACKET_TYPE) {
+        //the profiler wants to know where each lambda was read from
+        int line = profilerRunning && tokenSource == nextToken ? tokenLine()
+                                                               : 0;
+        Value *list = readList(token->type == OPEN_TYPE ? CLOSE_TYPE
+                                                        : CLOSEBRACKET_TYPE);
+        if (line > 0 && list->type == CONS_TYPE &&
+            car(list)->type == SYMBOL_TYPE &&
+            !strcmp(car(list)->s, "lambda") &&
+            cdr(list)->type == CONS_TYPE &&
+            cdr(cdr(list))->type == CONS_TYPE) {
+            recordLambdaSource(car(cdr(cdr(list))), line);
+        }
+        return list;
+    } else if (token->type == CLOSE_TYPE ||
+               token->type == CLOSEBRACKET_TYPE) {
+        syntaxError("Syntax error: too many close parentheses");
+    } else if (token->type == DOT_TYPE) {
+        syntaxError("Syntax error: unexpected dot");
+    } else if (token->type == SINGLEQUOTE_TYPE) {
+        Value *next = tokenSource();
+        if (next == NULL) {
+            syntaxError("Syntax error: nothing to quote");
         }
-        tree->c.car = subtree;
+        Value *quoteSymbol = makeNull();
+        quoteSymbol->type = SYMBOL_TYPE;
+        quoteSymbol->s = "quote";
+        return cons(quoteSymbol, cons(readFrom(next), makeNull()));
     }
-    return tree;
+    return token;
+}
+
+// Reads the next complete datum from stdin and returns its parse tree, or NULL
+// at end of input. Tokens are consumed as they are read, so no token list is
+// built.
+Value *readDatum() {
+    tokenSource = nextToken;
+    Value *token = nextToken();
+    if (token == NULL) {
+        return NULL;
+    }
+    return readFrom(token);
 }
 
 // Takes a list of tokens from a Racket program, and returns a pointer to a
 // parse tree representing that program.
 Value *parse(Value *tokens) {
+    assert(tokens != NULL && "Parse error: null token list");
+    tokenSource = nextListToken;
+    tokenCursor = tokens;
     Value *tree = makeNull();
-    int depth = 0;
-    Value *curNode = tokens;
-    assert(curNode != NULL && "Parse error: null token list");
-    while (curNode->type != NULL_TYPE) {
-        tree = updateTree(tree, &depth, car(curNode));
-        Value *next = cdr(curNode);
-        curNode = next;
+    Value *last = NULL;
+    Value *token = nextListToken();
+    while (token != NULL) {
+        Value *item = cons(readFrom(token), makeNull());
+        if (last == NULL) {
+            tree = item;
+        } else {
+            last->c.cdr = item;
+        }
+        last = item;
+        token = nextListToken();
     }
-    if (depth != 0) {
-        syntaxError("Syntax error: not enough close parentheses");
+    tokenSource = nextToken;
+    return tree;
+}
+
+// Inputs smaller than this are read on the calling thread; starting threads
+// would cost more than it saves.
+#define PARALLEL_READ_MIN (4 * 1024 * 1024)
+
+// A piece of the input read on its own thread, into its own allocator.
+typedef struct Chunk {
+    const char *data;
+    size_t length;
+    Allocator allocator;
+    Value *first;
+    Value *last;
+} Chunk;
+
+// Reads every datum in the chunk from the tokenizer's current input.
+void readChunkForms(Chunk *chunk) {
+    chunk->first = makeNull();
+    chunk->last = NULL;
+    Value *expr = readDatum();
+    while (expr != NULL) {
+        Value *item = cons(expr, makeNull());
+        if (chunk->last == NULL) {
+            chunk->first = item;
+        } else {
+            chunk->last->c.cdr = item;
+        }
+        chunk->last = item;
+        expr = readDatum();
+    }
+}
+
+void *readChunk(void *argument) {
+    Chunk *chunk = argument;
+    useAllocator(&chunk->allocator);
+    setInputBuffer(chunk->data, chunk->length);
+    readChunkForms(chunk);
+    outFlush();
+    return NULL;
+}
+
+// Finds where to split data into at most count chunks of about equal size,
+// storing the end of each chunk in ends and returning how many there are.
+// Splits are only made at newlines outside of any list, string or comment,
+// so every chunk holds whole top-level forms.
+int splitForms(const char *data, size_t length, size_t *ends, int count) {
+    size_t target = length / count;
+    int found = 0;
+    long depth = 0;
+    size_t pos = 0;
+    while (pos < length && found < count - 1) {
+        char c = data[pos];
+        if (c == '"') {
+            const char *close = memchr(data + pos + 1, '"', length - pos - 1);
+            pos = close != NULL ? (size_t)(close - data) + 1 : length;
+            continue;
+        } else if (c == ';') {
+            const char *newline = memchr(data + pos, '\n', length - pos);
+            pos = newline != NULL ? (size_t)(newline - data) : length;
+            continue;
+        } else if (c == '(' || c == '[') {
+            depth++;
+        } else if (c == ')' || c == ']') {
+            depth--;
+        } else if (c == '\n' && depth == 0 && pos >= target) {
+            ends[found++] = pos;
+            target = pos + (length - pos) / (count - found);
+        }
+        pos++;
     }
-    return reverse(tree);
+    ends[found++] = length;
+    return found;
 }
 
+Value *readForms(const char *data, size_t length) {
+    InputSource saved = saveInput();
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    char *requested = getenv("SCHEME_THREADS");
+    if (requested != NULL) {
+        threads = atoi(requested);
+    }
+    //chunks would count lines from their own start
+    if (profilerRunning) {
+        threads = 1;
+    }
+    if (threads > (int)(length / PARALLEL_READ_MIN)) {
+        threads = (int)(length / PARALLEL_READ_MIN);
+    }
+    Value *forms;
+    if (threads < 2) {
+        Chunk whole;
+        setInputBuffer(data, length);
+        readChunkForms(&whole);
+        forms = whole.first;
+    } else {
+        size_t *ends = talloc(threads * sizeof(size_t));
+        int count = splitForms(data, length, ends, threads);
+        Chunk *chunks = talloc(count * sizeof(Chunk));
+        pthread_t *workers = talloc(count * sizeof(pthread_t));
+        size_t start = 0;
+        for (int i = 0; i < count; i++) {
+            chunks[i].data = data + start;
+            chunks[i].length = ends[i] - start;
+            chunks[i].allocator.head = NULL;
+            start = ends[i];
+        }
+        //the first chunk is read here while the others are read in parallel
+        for (int i = 1; i < count; i++) {
+            pthread_create(&workers[i], NULL, readChunk, &chunks[i]);
+        }
+        setInputBuffer(chunks[0].data, chunks[0].length);
+        readChunkForms(&chunks[0]);
+        forms = chunks[0].first;
+        Value *last = chunks[0].last;
+        for (int i = 1; i < count; i++) {
+            pthread_join(workers[i], NULL);
+            adoptAllocator(&chunks[i].allocator);
+            if (chunks[i].last == NULL) {
+                continue;
+            }
+            if (last == NULL) {
+                forms = chunks[i].first;
+            } else {
+                last->c.cdr = chunks[i].first;
+            }
+            last = chunks[i].last;
+        }
+    }
+    restoreInput(saved);
+    return forms;
+}
 
 void printToken(Value *token) {
     if (token->type == SYMBOL_TYPE || token->type == STR_TYPE) {
-        printf("%s", token->s);
+        outString(token->s);
     } else if (token->type == INT_TYPE) {
-        printf("%i", token->i);
+        outInt(token->i);
     } else if (token->type == DOUBLE_TYPE) {
-        printf("%f", token->d);
+        outDouble(token->d);
     } else if (token->type == BOOL_TYPE) {
         int intBool = token->i;
         if (intBool == 0) {
-            printf("#f");
+            outString("#f");
         } else {
-            printf("#t");
+            outString("#t");
         }
     } else if (token->type ==  SINGLEQUOTE_TYPE) {
-        printf("quote");
+        outString("quote");
     } else if (token->type == DOT_TYPE) {
-        printf(".");
+        outChar('.');
     } else if (token->type == NULL_TYPE) {
-        printf("()");
+        outString("()");
     }
 }
 
@@ -83,7 +296,7 @@ void printSExpr(Value *tree) {
     if (tree->type != CONS_TYPE) {
         printToken(tree);
     } else {
-        printf("(");
+        outChar('(');
         while (tree->type != NULL_TYPE) {
             if (car(tree)->type == CONS_TYPE) {
                 printSExpr(car(tree));
@@ -92,12 +305,12 @@ void printSExpr(Value *tree) {
             }
             //add whitespace if not last token in expression
             if (cdr(tree)->type != NULL_TYPE) {
-                printf(" ");
+                outChar(' ');
             }
             Value *next = cdr(tree);
             tree = next;
         }
-        printf(")");
+        outChar(')');
     }
 }
 
@@ -107,7 +320,7 @@ void printTree(Value *tree) {
     while (tree->type != NULL_TYPE) {
         printSExpr(car(tree));
         tree = cdr(tree);
-        printf("\n");
+        outChar('\n');
     }
 }
 
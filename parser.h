@@ -7,6 +7,20 @@
 // parse tree representing that program.
 Value *parse(Value *tokens);
 
+// Reads the next complete datum from stdin and returns its parse tree, or NULL
+// at end of input. Quotes, brackets and dotted pairs are handled while reading.
+Value *readDatum();
+
+
+// Identifies what the tokenizer and parser make of a source text. Bump it
+// with any change to either that can read the same text differently, so
+// that forms cached by an older reader aren't used.
+#define READER_VERSION 3
+
+// Reads every datum in data[0, length) and returns them as a list, in order.
+// Large inputs are split at top-level form boundaries and the pieces are
+// parsed on separate threads; the result is the same as reading serially.
+Value *readForms(const char *data, size_t length);
 
 // Prints the tree to the screen in a readable fashion. It should look just like
 // Racket code; use parentheses to indicate subtrees.
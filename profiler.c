@@ -0,0 +1,266 @@
+/* A SIGPROF sampling profiler that attributes time to Scheme closures and
+ * writes collapsed stacks. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "profiler.h"
+
+// Samples are kept in one preallocated array, each as a header followed by
+// its stack entries, innermost first. Only the innermost MAX_SAMPLE_DEPTH
+// entries of a deeper stack are kept; the header is twice the number of
+// entries, plus one if some were left out.
+#define SAMPLE_SPACE (8 * 1024 * 1024)
+#define MAX_SAMPLE_DEPTH 256
+#define SAMPLE_INTERVAL_USEC 1000
+#define SAMPLE_END UINTPTR_MAX
+
+// Where a closure came from: the name it was defined as and the line its
+// lambda was read from, if known. Entries are malloced, because they are
+// written out after talloc's memory has been freed.
+typedef struct Source {
+    Value *body;
+    char *name;
+    char *file;
+    int line;
+} Source;
+
+int profilerRunning = 0;
+_Thread_local Value *shadowStack[SHADOW_STACK_SIZE];
+_Thread_local int shadowDepth = 0;
+
+uintptr_t *samples = NULL;
+atomic_size_t samplesUsed = 0;
+atomic_size_t samplesDropped = 0;
+char *profilePath = NULL;
+pid_t profiledProcess = 0;
+
+Source *sources = NULL;
+size_t sourceCapacity = 0;
+size_t sourceCount = 0;
+pthread_mutex_t sourceLock = PTHREAD_MUTEX_INITIALIZER;
+_Thread_local char *sourceName = "stdin";
+
+size_t hashBody(const void *pointer) {
+    uintptr_t bits = (uintptr_t)pointer;
+    bits ^= bits >> 33;
+    bits *= 0xff51afd7ed558ccdull;
+    bits ^= bits >> 33;
+    return bits;
+}
+
+// Returns the entry for body, adding an empty one if there is none. Must be
+// called with sourceLock held.
+Source *sourceEntry(Value *body) {
+    if (sourceCount * 2 >= sourceCapacity) {
+        size_t capacity = sourceCapacity ? sourceCapacity * 2 : 1024;
+        Source *grown = calloc(capacity, sizeof(Source));
+        for (size_t i = 0; i < sourceCapacity; i++) {
+            if (sources[i].body != NULL) {
+                size_t slot = hashBody(sources[i].body) & (capacity - 1);
+                while (grown[slot].body != NULL) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                grown[slot] = sources[i];
+            }
+        }
+        free(sources);
+        sources = grown;
+        sourceCapacity = capacity;
+    }
+    size_t slot = hashBody(body) & (sourceCapacity - 1);
+    while (sources[slot].body != NULL && sources[slot].body != body) {
+        slot = (slot + 1) & (sourceCapacity - 1);
+    }
+    if (sources[slot].body == NULL) {
+        sources[slot].body = body;
+        sourceCount++;
+    }
+    return &sources[slot];
+}
+
+// Returns the entry for body without adding one, or NULL.
+Source *findSource(Value *body) {
+    if (sourceCapacity == 0) {
+        return NULL;
+    }
+    size_t slot = hashBody(body) & (sourceCapacity - 1);
+    while (sources[slot].body != NULL) {
+        if (sources[slot].body == body) {
+            return &sources[slot];
+        }
+        slot = (slot + 1) & (sourceCapacity - 1);
+    }
+    return NULL;
+}
+
+void setSourceName(char *name) {
+    sourceName = name;
+}
+
+void recordLambdaSource(Value *body, int line) {
+    pthread_mutex_lock(&sourceLock);
+    Source *source = sourceEntry(body);
+    source->file = strdup(sourceName);
+    source->line = line;
+    pthread_mutex_unlock(&sourceLock);
+}
+
+void nameProcedure(Value *body, char *name) {
+    pthread_mutex_lock(&sourceLock);
+    Source *source = sourceEntry(body);
+    if (source->name == NULL) {
+        source->name = strdup(name);
+    }
+    pthread_mutex_unlock(&sourceLock);
+}
+
+// Copies the interrupted thread's shadow stack into the sample space. Only
+// touches memory reserved with an atomic add, so it is safe in a handler.
+void takeSample(int signalNumber) {
+    (void)signalNumber;
+    int depth = shadowDepth;
+    int kept = depth;
+    if (kept > SHADOW_STACK_SIZE) {
+        kept = SHADOW_STACK_SIZE;
+    }
+    if (kept > MAX_SAMPLE_DEPTH) {
+        kept = MAX_SAMPLE_DEPTH;
+    }
+    size_t start = atomic_fetch_add(&samplesUsed, kept + 1);
+    if (start + kept + 1 > SAMPLE_SPACE) {
+        //mark where the complete samples end
+        if (start < SAMPLE_SPACE) {
+            samples[start] = SAMPLE_END;
+        }
+        atomic_fetch_add(&samplesDropped, 1);
+        return;
+    }
+    samples[start] = kept * 2 + (kept < depth);
+    int top = depth < SHADOW_STACK_SIZE ? depth : SHADOW_STACK_SIZE;
+    for (int i = 0; i < kept; i++) {
+        samples[start + 1 + i] = (uintptr_t)shadowStack[top - 1 - i];
+    }
+}
+
+// Writes the frame for a stack entry.
+void writeFrame(FILE *file, uintptr_t entry) {
+    Source *source = findSource((Value *)entry);
+    if (source == NULL) {
+        fprintf(file, "lambda");
+        return;
+    }
+    fprintf(file, "%s", source->name != NULL ? source->name : "lambda");
+    if (source->file != NULL) {
+        fprintf(file, " (%s:%d)", source->file, source->line);
+    }
+}
+
+// A distinct stack, found at offset in the sample space, and how many
+// samples had it.
+typedef struct Stack {
+    size_t offset;
+    size_t count;
+} Stack;
+
+size_t hashSample(uintptr_t *sample) {
+    size_t hash = 0;
+    for (uintptr_t i = 0; i <= sample[0] / 2; i++) {
+        hash = (hash ^ sample[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+int sameSample(uintptr_t *first, uintptr_t *second) {
+    return first[0] == second[0] &&
+           !memcmp(first + 1, second + 1, first[0] / 2 * sizeof(uintptr_t));
+}
+
+// Groups identical samples and writes one collapsed line for each.
+void writeProfile() {
+    if (getpid() != profiledProcess) {
+        return;
+    }
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    profilerRunning = 0;
+    FILE *file = fopen(profilePath, "w");
+    if (file == NULL) {
+        fprintf(stderr, "could not write profile to %s\n", profilePath);
+        return;
+    }
+    size_t used = atomic_load(&samplesUsed);
+    if (used > SAMPLE_SPACE) {
+        used = SAMPLE_SPACE;
+    }
+    size_t capacity = 1024;
+    while (capacity < used) {
+        capacity *= 2;
+    }
+    Stack *stacks = calloc(capacity, sizeof(Stack));
+    size_t offset = 0;
+    while (offset < used && samples[offset] != SAMPLE_END &&
+           offset + samples[offset] / 2 + 1 <= used) {
+        uintptr_t *sample = samples + offset;
+        size_t slot = hashSample(sample) & (capacity - 1);
+        while (stacks[slot].count != 0 &&
+               !sameSample(samples + stacks[slot].offset, sample)) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (stacks[slot].count == 0) {
+            stacks[slot].offset = offset;
+        }
+        stacks[slot].count++;
+        offset += sample[0] / 2 + 1;
+    }
+    for (size_t i = 0; i < capacity; i++) {
+        if (stacks[i].count == 0) {
+            continue;
+        }
+        uintptr_t *sample = samples + stacks[i].offset;
+        fprintf(file, "[toplevel]");
+        if (sample[0] % 2) {
+            fprintf(file, ";[truncated]");
+        }
+        //entries are stored innermost first
+        for (uintptr_t j = sample[0] / 2; j > 0; j--) {
+            fputc(';', file);
+            writeFrame(file, sample[j]);
+        }
+        fprintf(file, " %zu\n", stacks[i].count);
+    }
+    if (atomic_load(&samplesDropped) > 0) {
+        fprintf(stderr, "profile: %zu samples dropped\n",
+                atomic_load(&samplesDropped));
+    }
+    fclose(file);
+    free(stacks);
+}
+
+void startProfiler(char *outputPath) {
+    samples = malloc(SAMPLE_SPACE * sizeof(uintptr_t));
+    if (samples == NULL) {
+        fprintf(stderr, "could not allocate profile samples\n");
+        return;
+    }
+    profilePath = outputPath;
+    profiledProcess = getpid();
+    profilerRunning = 1;
+    atexit(writeProfile);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = takeSample;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, NULL);
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = SAMPLE_INTERVAL_USEC;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
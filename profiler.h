@@ -0,0 +1,47 @@
+#include "value.h"
+
+#ifndef _PROFILER
+#define _PROFILER
+
+// A sampling profiler for Scheme code. While it runs, apply keeps a shadow
+// stack of the closures being called, and a SIGPROF timer records that stack
+// about a thousand times a second of CPU time. Closures are named by the
+// define that bound them and the line their lambda was read from. When the
+// program exits the samples are written as collapsed stacks, one line per
+// distinct stack with its count, the input flamegraph tools expect.
+
+#define SHADOW_STACK_SIZE 4096
+
+// Set while the profiler is running.
+extern int profilerRunning;
+
+// The bodies of the closures being applied on this thread, outermost first.
+// Calls deeper than SHADOW_STACK_SIZE are counted but not kept.
+extern _Thread_local Value *shadowStack[SHADOW_STACK_SIZE];
+extern _Thread_local int shadowDepth;
+
+// Starts sampling, with the collapsed stacks written to outputPath on exit.
+void startProfiler(char *outputPath);
+
+// Records that the lambda whose first body form is body was read from line
+// of the current source.
+void recordLambdaSource(Value *body, int line);
+
+// Records that the closures with the given body are bound to name.
+void nameProcedure(Value *body, char *name);
+
+// Names the source that recordLambdaSource attributes lines to.
+void setSourceName(char *name);
+
+static inline void enterProcedure(Value *body) {
+    if (shadowDepth < SHADOW_STACK_SIZE) {
+        shadowStack[shadowDepth] = body;
+    }
+    shadowDepth++;
+}
+
+static inline void leaveProcedure() {
+    shadowDepth--;
+}
+
+#endif
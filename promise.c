@@ -0,0 +1,104 @@
+/* Memoizing promises, forced without recursion. */
+#include "promise.h"
+#include "interpreter.h"
+#include "linkedlist.h"
+#include "talloc.h"
+
+Value *makePromise(Value *expr, Frame *frame, int chained) {
+    //the expression runs as a procedure of no arguments
+    Value *thunk = makeNull();
+    thunk->type = CLOSURE_TYPE;
+    thunk->closure.paramNames = makeNull();
+    thunk->closure.fnBody = expr;
+    thunk->closure.frame = frame;
+    Value *promise = makeNull();
+    promise->type = PROMISE_TYPE;
+    promise->promise.state = chained ? PROMISE_CHAINED : PROMISE_PENDING;
+    promise->promise.content = thunk;
+    return promise;
+}
+
+// Follows forwarding links to the promise that holds promise's state.
+Value *resolvePromise(Value *promise) {
+    while (promise->promise.state == PROMISE_FORWARDED) {
+        promise = promise->promise.content;
+    }
+    return promise;
+}
+
+Value *force(Value *promise) {
+    if (promise->type != PROMISE_TYPE) {
+        return promise;
+    }
+    while (1) {
+        promise = resolvePromise(promise);
+        if (promise->promise.state == PROMISE_FORCED) {
+            return promise->promise.content;
+        }
+        int chained = promise->promise.state == PROMISE_CHAINED;
+        Value *result = apply(promise->promise.content, makeNull());
+        //forcing the expression may have forced this promise already
+        promise = resolvePromise(promise);
+        if (promise->promise.state == PROMISE_FORCED) {
+            return promise->promise.content;
+        }
+        if (!chained || result->type != PROMISE_TYPE) {
+            promise->promise.state = PROMISE_FORCED;
+            promise->promise.content = result;
+            return result;
+        }
+        //take over the next promise's work, and have it forward here
+        Value *next = resolvePromise(result);
+        if (next == promise) {
+            continue;
+        }
+        promise->promise = next->promise;
+        next->promise.state = PROMISE_FORWARDED;
+        next->promise.content = promise;
+    }
+}
+
+Value *primitiveForce(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for force");
+    }
+    return force(car(args));
+}
+
+Value *primitiveMakePromise(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for make-promise");
+    }
+    if (car(args)->type == PROMISE_TYPE) {
+        return car(args);
+    }
+    Value *promise = makeNull();
+    promise->type = PROMISE_TYPE;
+    promise->promise.state = PROMISE_FORCED;
+    promise->promise.content = car(args);
+    return promise;
+}
+
+Value *primitivePromiseP(Value *args) {
+    if (length(args) != 1) {
+        evalError("wrong number of args for promise?");
+    }
+    Value *result = makeNull();
+    result->type = BOOL_TYPE;
+    result->i = car(args)->type == PROMISE_TYPE;
+    return result;
+}
+
+Value *primitiveStreamCar(Value *args) {
+    if (length(args) != 1 || car(args)->type != CONS_TYPE) {
+        evalError("stream-car expects a stream");
+    }
+    return car(car(args));
+}
+
+Value *primitiveStreamCdr(Value *args) {
+    if (length(args) != 1 || car(args)->type != CONS_TYPE) {
+        evalError("stream-cdr expects a stream");
+    }
+    return force(cdr(car(args)));
+}
@@ -0,0 +1,37 @@
+#include "value.h"
+
+#ifndef _PROMISE
+#define _PROMISE
+
+// Promises, for delay, delay-force and cons-stream. A promise is forced at
+// most once and remembers its value. Forcing a chain of delay-force
+// promises runs in a loop: each promise in the chain hands its pending
+// work to the one being forced and then forwards to it, so the C stack
+// stays flat and the finished links aren't kept alive by the chain.
+
+// Returns a promise to evaluate expr in frame. With chained set, as for
+// delay-force, the value of expr must be a promise, which the new one
+// takes the value of.
+Value *makePromise(Value *expr, Frame *frame, int chained);
+
+// Returns the value of promise, forcing it if it hasn't been. Anything
+// other than a promise is its own value.
+Value *force(Value *promise);
+
+// (force promise): the value of promise.
+Value *primitiveForce(Value *args);
+
+// (make-promise value): a promise that has already been forced to value,
+// or value itself if it is a promise.
+Value *primitiveMakePromise(Value *args);
+
+// (promise? value): whether value is a promise.
+Value *primitivePromiseP(Value *args);
+
+// (stream-car stream): the first item of a stream made by cons-stream.
+Value *primitiveStreamCar(Value *args);
+
+// (stream-cdr stream): the rest of a stream, forcing it if needed.
+Value *primitiveStreamCdr(Value *args);
+
+#endif
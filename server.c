@@ -0,0 +1,168 @@
+/* A pre-forked evaluation server. The parent evaluates the prelude once,
+ * then forks workers that inherit the warmed global frame and answer
+ * requests on a Unix domain socket. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "server.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "tokenizer.h"
+#include "output.h"
+#include "talloc.h"
+
+volatile sig_atomic_t stopServer = 0;
+
+void handleStop(int signalNumber) {
+    (void)signalNumber;
+    stopServer = 1;
+}
+
+void serverError(char *message, char *path) {
+    outString("Server error: ");
+    outString(message);
+    outString(": ");
+    outString(path);
+    outChar('\n');
+    outFlush();
+    texit(1);
+}
+
+// Fills address with the socket address for path.
+void socketAddress(char *path, struct sockaddr_un *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        serverError("socket path too long", path);
+    }
+    strcpy(address->sun_path, path);
+}
+
+// Evaluates the program sent on connection, writing its output back.
+void serveRequest(int connection, Frame *globalFrame) {
+    //definitions made by the request are dropped afterwards by putting
+    //the global bindings list back the way it was
+    Value *bindings = globalFrame->bindings;
+    setInputFd(connection);
+    setOutputFd(connection);
+    Value *expr = readDatum();
+    while (expr != NULL) {
+        interpretExpr(expr, globalFrame);
+        expr = readDatum();
+    }
+    outFlush();
+    globalFrame->bindings = bindings;
+}
+
+// The body of a worker: answers requests until recycled or told to stop.
+void runWorker(int listener, Frame *globalFrame, int recycleAfter) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    int served = 0;
+    while (recycleAfter == 0 || served < recycleAfter) {
+        int connection = accept(listener, NULL, NULL);
+        if (connection < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        serveRequest(connection, globalFrame);
+        close(connection);
+        served++;
+    }
+    texit(0);
+}
+
+pid_t startWorker(int listener, Frame *globalFrame, int recycleAfter) {
+    outFlush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        runWorker(listener, globalFrame, recycleAfter);
+    }
+    return pid;
+}
+
+void runServer(char *socketPath, Frame *globalFrame, int workers,
+               int recycleAfter) {
+    struct sockaddr_un address;
+    socketAddress(socketPath, &address);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        serverError("could not create socket", socketPath);
+    }
+    unlink(socketPath);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(listener, 128) < 0) {
+        serverError("could not listen on socket", socketPath);
+    }
+    //a client hanging up early must not kill the worker writing to it
+    signal(SIGPIPE, SIG_IGN);
+    struct sigaction stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = handleStop;
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+
+    if (workers < 1) {
+        workers = 1;
+    }
+    pid_t *pool = talloc(workers * sizeof(pid_t));
+    for (int i = 0; i < workers; i++) {
+        pool[i] = startWorker(listener, globalFrame, recycleAfter);
+    }
+    while (!stopServer) {
+        int status;
+        pid_t finished = wait(&status);
+        if (finished < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = 0; i < workers; i++) {
+            if (pool[i] == finished && !stopServer) {
+                pool[i] = startWorker(listener, globalFrame, recycleAfter);
+            }
+        }
+    }
+    for (int i = 0; i < workers; i++) {
+        kill(pool[i], SIGTERM);
+    }
+    while (wait(NULL) > 0 || errno == EINTR) {
+    }
+    close(listener);
+    unlink(socketPath);
+}
+
+int runClient(char *socketPath) {
+    struct sockaddr_un address;
+    socketAddress(socketPath, &address);
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0 ||
+        connect(connection, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        fprintf(stderr, "could not connect to %s\n", socketPath);
+        return 1;
+    }
+    char buffer[65536];
+    ssize_t length;
+    while ((length = read(0, buffer, sizeof(buffer))) > 0) {
+        if (write(connection, buffer, length) != length) {
+            break;
+        }
+    }
+    shutdown(connection, SHUT_WR);
+    while ((length = read(connection, buffer, sizeof(buffer))) > 0) {
+        if (write(1, buffer, length) != length) {
+            break;
+        }
+    }
+    close(connection);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#include "value.h"
+
+#ifndef _SERVER
+#define _SERVER
+
+// Serves Scheme programs over a Unix domain socket at socketPath. A pool of
+// workers forked from this process share the already evaluated global frame
+// copy-on-write. Each worker accepts a connection, reads the program sent on
+// it until the client shuts down its side, and writes back what the program
+// prints. Definitions a program makes are dropped once it finishes. Each
+// worker exits after recycleAfter programs (0 for never), or on an error,
+// and is replaced by a fresh fork. Returns when the server is sent SIGINT or
+// SIGTERM.
+void runServer(char *socketPath, Frame *globalFrame, int workers,
+               int recycleAfter);
+
+// Sends stdin to the server at socketPath as a program and copies the reply
+// to stdout. Returns 0 on success, 1 if the server couldn't be reached.
+int runClient(char *socketPath);
+
+#endif
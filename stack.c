@@ -0,0 +1,132 @@
+/* Stack segments for deep recursion, switched to with ucontext. */
+#define _GNU_SOURCE
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "stack.h"
+#include "interpreter.h"
+
+// Room reserved for each segment, mapped lazily like a task's stack, with a
+// guard page at the bottom.
+#define SEGMENT_SIZE (8 * 1024 * 1024)
+#define GUARD_SIZE 4096
+// Room left below the limit of a stack for what runs between two evals:
+// primitives, the printer, a profiler signal.
+#define STACK_MARGIN (256 * 1024)
+// Segments kept mapped for reuse once a recursion has returned from them.
+#define MAX_FREE_SEGMENTS 4
+
+// A segment's bookkeeping sits just above its guard page, below its stack.
+typedef struct Segment {
+    ucontext_t context;
+    ucontext_t caller;
+    Value *tree;
+    Frame *frame;
+    Value *result;
+    struct Segment *next;
+} Segment;
+
+// A limit no stack address is above, for a thread whose stack hasn't been
+// measured, so its first eval comes here to measure it.
+#define UNMEASURED ((char *)~(unsigned long)0)
+
+_Thread_local EvalStack evalStack = {UNMEASURED, 0};
+_Thread_local Segment *freeSegments = NULL;
+_Thread_local int freeSegmentCount = 0;
+// The segment a new context is starting on, as makecontext can only pass
+// ints.
+_Thread_local Segment *startingSegment = NULL;
+
+unsigned long maxEvalDepth = ULONG_MAX;
+
+EvalStack newEvalStack(void *base) {
+    EvalStack stack;
+    stack.limit = (char *)base + STACK_MARGIN;
+    stack.depth = 0;
+    return stack;
+}
+
+// Sets the limit of the thread's own stack from where the system put it,
+// and reads $SCHEME_MAX_DEPTH. A thread whose stack can't be found keeps
+// to it, as if there were no segments.
+void measureStack() {
+    char *requested = getenv("SCHEME_MAX_DEPTH");
+    if (requested != NULL && atol(requested) > 0) {
+        maxEvalDepth = atol(requested);
+    }
+    evalStack.limit = NULL;
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) != 0) {
+        return;
+    }
+    void *base;
+    size_t size;
+    if (pthread_attr_getstack(&attributes, &base, &size) == 0) {
+        evalStack.limit = (char *)base + STACK_MARGIN;
+    }
+    pthread_attr_destroy(&attributes);
+}
+
+Segment *takeSegment() {
+    if (freeSegments != NULL) {
+        Segment *segment = freeSegments;
+        freeSegments = segment->next;
+        freeSegmentCount--;
+        return segment;
+    }
+    char *memory = mmap(NULL, SEGMENT_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) {
+        evalError("out of memory for deep recursion");
+    }
+    mprotect(memory, GUARD_SIZE, PROT_NONE);
+    Segment *segment = (Segment *)(memory + GUARD_SIZE);
+    getcontext(&segment->context);
+    return segment;
+}
+
+// Keeps a few segments for the next deep recursion and unmaps the rest.
+void releaseSegment(Segment *segment) {
+    if (freeSegmentCount < MAX_FREE_SEGMENTS) {
+        segment->next = freeSegments;
+        freeSegments = segment;
+        freeSegmentCount++;
+    } else {
+        munmap((char *)segment - GUARD_SIZE, SEGMENT_SIZE);
+    }
+}
+
+// Where a segment's context starts. Returning resumes the caller, through
+// uc_link.
+void runSegment() {
+    Segment *segment = startingSegment;
+    segment->result = eval(segment->tree, segment->frame);
+}
+
+Value *evalOnNewSegment(Value *tree, Frame *frame) {
+    char here;
+    if (evalStack.limit == UNMEASURED) {
+        measureStack();
+        if (&here >= evalStack.limit) {
+            return eval(tree, frame);
+        }
+    }
+    Segment *segment = takeSegment();
+    segment->tree = tree;
+    segment->frame = frame;
+    segment->context.uc_stack.ss_sp = segment + 1;
+    segment->context.uc_stack.ss_size = SEGMENT_SIZE - GUARD_SIZE -
+                                        sizeof(Segment);
+    segment->context.uc_link = &segment->caller;
+    makecontext(&segment->context, runSegment, 0);
+    char *limit = evalStack.limit;
+    evalStack.limit = (char *)(segment + 1) + STACK_MARGIN;
+    startingSegment = segment;
+    swapcontext(&segment->caller, &segment->context);
+    evalStack.limit = limit;
+    Value *result = segment->result;
+    releaseSegment(segment);
+    return result;
+}
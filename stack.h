@@ -0,0 +1,36 @@
+#include "value.h"
+
+#ifndef _STACK
+#define _STACK
+
+// Deep recursion. eval runs on the C stack of its thread or task until that
+// is nearly used up, then carries on on a segment of stack mapped from the
+// heap, and on another when that one fills, so non-tail recursion is limited
+// by memory rather than by the size of the first stack. Segments are handed
+// back as the recursion returns. With $SCHEME_MAX_DEPTH set, evaluations
+// nested deeper than that in one thread or task are an evaluation error.
+
+// Where eval is on the stack it runs on: past limit it must move to a new
+// segment. depth counts the evaluations in progress.
+typedef struct EvalStack {
+    char *limit;
+    unsigned long depth;
+} EvalStack;
+
+// The state of the running thread or task. Tasks swap theirs in and out as
+// they take turns.
+extern _Thread_local EvalStack evalStack;
+
+// The most evaluations that may be in progress at once.
+extern unsigned long maxEvalDepth;
+
+// The state for a task whose stack starts at base, its lowest usable
+// address.
+EvalStack newEvalStack(void *base);
+
+// Evaluates tree in frame once eval has found itself past the limit of the
+// stack it is on: on a new segment, or where it is if the thread's stack
+// hadn't been measured yet.
+Value *evalOnNewSegment(Value *tree, Frame *frame);
+
+#endif
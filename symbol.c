@@ -0,0 +1,68 @@
+/* Interning of symbol names, in an open-addressing hash table. */
+#include <stdint.h>
+#include <string.h>
+#include "symbol.h"
+#include "talloc.h"
+
+_Thread_local SymbolTable *symbols = NULL;
+
+void useSymbolTable(SymbolTable *table) {
+    symbols = table;
+}
+
+uint64_t hashName(const char *text, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)text[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Returns where the name in text[0, length) is or would go in names.
+size_t findName(char **names, size_t capacity, const char *text,
+                size_t length) {
+    size_t slot = hashName(text, length) & (capacity - 1);
+    while (names[slot] != NULL &&
+           (strncmp(names[slot], text, length) != 0 ||
+            names[slot][length] != '\0')) {
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return slot;
+}
+
+// Doubles the table. The old array is left to talloc to free with the rest.
+void growSymbols(SymbolTable *table) {
+    size_t capacity = table->capacity ? table->capacity * 2 : 1024;
+    char **names = talloc(capacity * sizeof(char *));
+    memset(names, 0, capacity * sizeof(char *));
+    for (size_t i = 0; i < table->capacity; i++) {
+        char *name = table->names[i];
+        if (name != NULL) {
+            names[findName(names, capacity, name, strlen(name))] = name;
+        }
+    }
+    table->names = names;
+    table->capacity = capacity;
+}
+
+char *internSymbol(const char *text, size_t length) {
+    SymbolTable *table = symbols;
+    if (table != NULL) {
+        if (table->count * 2 >= table->capacity) {
+            growSymbols(table);
+        }
+        size_t slot = findName(table->names, table->capacity, text, length);
+        if (table->names[slot] != NULL) {
+            return table->names[slot];
+        }
+    }
+    char *name = talloc(length + 1);
+    memcpy(name, text, length);
+    name[length] = '\0';
+    if (table != NULL) {
+        table->names[findName(table->names, table->capacity, text,
+                              length)] = name;
+        table->count++;
+    }
+    return name;
+}
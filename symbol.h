@@ -0,0 +1,31 @@
+#include <stddef.h>
+#include <string.h>
+
+#ifndef _SYMBOL
+#define _SYMBOL
+
+// A table of interned symbol names. Interning gives every occurrence of a
+// name read by the tokenizer the same string, so names can usually be
+// compared by pointer before falling back to strcmp.
+typedef struct SymbolTable {
+    char **names;
+    size_t capacity;
+    size_t count;
+} SymbolTable;
+
+// Makes table the one that internSymbol adds to on the calling thread. With
+// NULL, internSymbol just copies names.
+void useSymbolTable(SymbolTable *table);
+
+// Returns the interned copy of the name in text[0, length), adding it to the
+// table if it isn't there yet. Names are allocated with talloc.
+char *internSymbol(const char *text, size_t length);
+
+// Whether two symbol names are the same. Interned names are equal exactly
+// when they are the same pointer; names from elsewhere still compare by
+// content.
+static inline int sameName(const char *name1, const char *name2) {
+    return name1 == name2 || !strcmp(name1, name2);
+}
+
+#endif
@@ -1,49 +1,55 @@
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <assert.h>
 #include "talloc.h"
 
-Value *head = NULL;
+// Allocations are carved out of large blocks, which are kept in a linked list
+// so that tfree can release them all at once. Allocating is then a pointer
+// bump instead of a malloc per value.
+typedef struct Block {
+  struct Block *next;
+  size_t size;
+  size_t used;
+  max_align_t data[];
+} Block;
 
-// Create a new NULL_TYPE value node.
-Value *tMakeNull() {
-  Value *nullNode = malloc(sizeof(Value));
-  nullNode->type = NULL_TYPE;
-  return nullNode;
-}
+#define BLOCK_SIZE (256 * 1024)
+#define ALIGNMENT (sizeof(max_align_t))
 
-// Create a new CONS_TYPE value node.
-Value *tCons(Value *newCar, Value *newCdr) {
-  Value *consCell = malloc(sizeof(Value));
-  consCell->type = CONS_TYPE;
-  consCell->c.car = newCar;
-  consCell->c.cdr = newCdr;
-  return consCell;
+// Each thread allocates from its own blocks unless an allocator has been
+// installed, so threads never contend here.
+_Thread_local Allocator threadAllocator = {NULL};
+_Thread_local Allocator *allocator = NULL;
+_Thread_local TallocStats stats = {0, 0, 0};
+
+TallocStats tallocStats() {
+  return stats;
 }
 
-Value *tCar(Value *list) {
-  assert(list != NULL);
-  assert(list->type == CONS_TYPE);
-  return list->c.car;
+void useAllocator(Allocator *newAllocator) {
+  allocator = newAllocator;
 }
 
-// Utility to make it less typing to get cdr value. Use assertions to make sure that this is a legitimate operation.
-Value *tCdr(Value *list)  {
-  assert(list != NULL);
-  assert(list->type == CONS_TYPE);
-  return list->c.cdr;
+// The allocator talloc and tfree use on this thread.
+static inline Allocator *currentAllocator() {
+  return allocator != NULL ? allocator : &threadAllocator;
 }
 
-// Utility to check if pointing to a NULL_TYPE value. Use assertions to make sure that this is a legitimate operation.
-bool tIsNull(Value *value) {
-  assert(value != NULL);
-  if (value->type == NULL_TYPE) {
-    return 1;
-  } else {
-    return 0;
+// Create a new block with room for at least size bytes.
+Block *newBlock(size_t size) {
+  Block *block = malloc(sizeof(Block) + size);
+  if (block == NULL) {
+    printf("Out of memory\n");
+    texit(1);
   }
+  block->size = size;
+  block->used = 0;
+  stats.blocks++;
+  return block;
 }
 
 // Replacement for malloc that stores the pointers allocated. It should store
@@ -52,33 +58,67 @@ bool tIsNull(Value *value) {
 // pre-existing linkedlist.h. Otherwise you'll end up with circular
 // dependencies, since you're going to modify the linked list to use talloc.
 void *talloc(size_t size){
-  if (head == NULL) {
-    head = tMakeNull();
+  Allocator *current = currentAllocator();
+  Block *head = current->head;
+  size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  stats.calls++;
+  stats.bytes += size;
+  if (head == NULL || head->size - head->used < size) {
+    if (size > BLOCK_SIZE / 4) {
+      //large allocations get a block of their own, leaving the current
+      //block in place for the small ones that follow
+      Block *block = newBlock(size);
+      block->used = size;
+      if (head == NULL) {
+        block->next = NULL;
+        current->head = block;
+      } else {
+        block->next = head->next;
+        head->next = block;
+      }
+      return block->data;
+    }
+    Block *block = newBlock(BLOCK_SIZE);
+    block->next = head;
+    head = block;
+    current->head = block;
   }
-  void *item = malloc(size);
-  Value *pointer = malloc(sizeof(Value));
-  pointer->type = PTR_TYPE;
-  pointer->p = item;
-  Value *temp = head;
-  head = tCons(pointer, temp);
+  void *item = (char *)head->data + head->used;
+  head->used += size;
   return item;
 }
 
+void adoptAllocator(Allocator *other) {
+  Allocator *current = currentAllocator();
+  Block *first = other->head;
+  if (first == NULL) {
+    return;
+  }
+  Block *last = first;
+  while (last->next != NULL) {
+    last = last->next;
+  }
+  //the adopted blocks go behind head, which stays the one bumped from
+  if (current->head == NULL) {
+    current->head = first;
+  } else {
+    last->next = current->head->next;
+    current->head->next = first;
+  }
+  other->head = NULL;
+}
+
 // Free all pointers allocated by talloc, as well as whatever memory you
 // allocated in lists to hold those pointers.
 void tfree(){
-  Value *current = head;
-  while(!tIsNull(current)){
-
-    Value *pointerValue = tCar(current);
-    free(pointerValue->p);
-    free(pointerValue);
-    Value *temp = tCdr(current);
-    free(current);
-    current = temp;
+  Allocator *current = currentAllocator();
+  Block *block = current->head;
+  while (block != NULL) {
+    Block *temp = block->next;
+    free(block);
+    block = temp;
   }
-  free(current);
-  head = NULL;
+  current->head = NULL;
 }
 
 // Replacement for the C function "exit", that consists of two lines: it calls
@@ -87,4 +127,13 @@ void tfree(){
 void texit(int status) {
   tfree();
   exit(status);
-}
\ No newline at end of file
+}
+
+_Thread_local jmp_buf *errorExit = NULL;
+
+void abandonEvaluation() {
+  if (errorExit != NULL) {
+    longjmp(*errorExit, 1);
+  }
+  texit(1);
+}
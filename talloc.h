@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <setjmp.h>
 #include "value.h"
 
 #ifndef _TALLOC
@@ -11,8 +12,36 @@
 // dependencies, since you're going to modify the linked list to use talloc.
 void *talloc(size_t size);
 
+// The blocks talloc carves allocations out of. Each thread starts with one
+// of its own; an interpreter instance has its own too, and installs it with
+// useAllocator while it runs.
+typedef struct Allocator {
+    struct Block *head;
+} Allocator;
+
+// Make talloc and tfree on the calling thread use allocator. NULL goes back
+// to the thread's own allocator.
+void useAllocator(Allocator *allocator);
+
+// Moves every block of other into the calling thread's current allocator, so
+// that what was allocated from other is freed along with it. other is left
+// empty.
+void adoptAllocator(Allocator *other);
+
+// What talloc has handed out on the calling thread since it started: how
+// many calls, how many bytes including alignment, and how many blocks were
+// taken from malloc. Freeing doesn't reset these.
+typedef struct TallocStats {
+    size_t calls;
+    size_t bytes;
+    size_t blocks;
+} TallocStats;
+
+TallocStats tallocStats();
+
 // Free all pointers allocated by talloc, as well as whatever memory you
-// allocated in lists to hold those pointers.
+// allocated in lists to hold those pointers. This frees everything from the
+// calling thread's current allocator.
 void tfree();
 
 // Replacement for the C function "exit", that consists of two lines: it calls
@@ -20,5 +49,14 @@ void tfree();
 // you can exit your program, and all memory is automatically cleaned up.
 void texit(int status);
 
+// Where an error on the calling thread goes back to: set with setjmp by an
+// entry point that carries on after errors, such as interpretString, and
+// NULL for the standalone program, which exits on the first one.
+extern _Thread_local jmp_buf *errorExit;
+
+// Called once an error's message has been printed: longjmps to errorExit,
+// or exits with texit(1) if there is none.
+void abandonEvaluation();
+
 #endif
 
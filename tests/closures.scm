@@ -0,0 +1,48 @@
+; A closure sees a define that runs after it is made in a body around it,
+; even of a name that was global when it was made.
+(define f
+  (lambda (lst)
+    (begin
+      (define g (lambda (x) (length x)))
+      (define length (lambda (x) 42))
+      (g lst))))
+(f (list 1 2 3))
+(length (list 1 2 3))
+
+(define helper (lambda () 99))
+(define h
+  (lambda ()
+    (begin
+      (define call (lambda () (helper)))
+      (define helper (lambda () 7))
+      (call))))
+(h)
+(helper)
+
+; Or a second define of a name that was local already.
+(define k
+  (lambda (n)
+    (begin
+      (define show (lambda () n))
+      (define n (* n 10))
+      (show))))
+(k 4)
+
+; The same in a let body.
+(let ((v 1))
+  (begin
+    (define get (lambda () (+ v 0)))
+    (define + (lambda (a b) (list a b)))
+    (get)))
+
+; A closure made where nothing can define still sees set!.
+(define counter
+  (lambda ()
+    (let ((count 0))
+      (lambda ()
+        (begin
+          (set! count (+ count 1))
+          count)))))
+(define next (counter))
+(next)
+(next)
@@ -0,0 +1,9 @@
+; Macros defined by the prelude survive being saved in a heap image.
+(sq 5)
+(force p)
+(twice (display "hi"))
+(newline)
+(define x 1)
+(define y 2)
+(swap! x y)
+(list x y)
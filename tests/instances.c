@@ -0,0 +1,70 @@
+/* Runs two interpreter instances at once on two threads, one of which
+ * raises an error, and checks that the error ends only that instance's
+ * evaluation: the other finishes, and the failing one can still be used.
+ * Exits with status 0 if so. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../interpreter.h"
+#include "../output.h"
+
+typedef struct Run {
+    const char *program;
+    const char *expected;
+    int expectedStatus;
+    int status;
+    int matched;
+} Run;
+
+// Evaluates run->program in a new instance, printing into a temporary
+// file, and compares what was printed and the status with those expected.
+void *runInstance(void *argument) {
+    Run *run = argument;
+    char path[] = "/tmp/instancesXXXXXX";
+    int fd = mkstemp(path);
+    unlink(path);
+    setOutputFd(fd);
+    Interpreter *interp = newInterpreter();
+    run->status = interpretString(interp, run->program,
+                                  strlen(run->program));
+    //the instance carries on after an error
+    const char *after = "(+ 1 2)";
+    run->status |= interpretString(interp, after, strlen(after)) << 1;
+    outFlush();
+    freeInterpreter(interp);
+    char printed[256] = {0};
+    lseek(fd, 0, SEEK_SET);
+    read(fd, printed, sizeof(printed) - 1);
+    close(fd);
+    run->matched = !strcmp(printed, run->expected);
+    if (!run->matched) {
+        fprintf(stderr, "printed \"%s\", expected \"%s\"\n", printed,
+                run->expected);
+    }
+    return NULL;
+}
+
+int main() {
+    Run runs[] = {
+        {"(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) "
+         "(fib (- n 2))))))\n(fib 22)\n",
+         "17711\n3\n", 0},
+        {"(define x 5)\n(car x)\n(define y 6)\n",
+         "Evaluation error: car applied to non-cons type3\n", 1},
+    };
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++) {
+        pthread_create(&threads[i], NULL, runInstance, &runs[i]);
+    }
+    int failed = 0;
+    for (int i = 0; i < 2; i++) {
+        pthread_join(threads[i], NULL);
+        if (runs[i].status != runs[i].expectedStatus || !runs[i].matched) {
+            fprintf(stderr, "instance %d: status %d\n", i, runs[i].status);
+            failed = 1;
+        }
+    }
+    return failed;
+}
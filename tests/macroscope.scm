@@ -0,0 +1,53 @@
+; Expansion builds new forms instead of overwriting the use, so a pattern
+; variable used both quoted and as code keeps its original text.
+(define-syntax show
+  (syntax-rules ()
+    ((_ e) (begin (write (quote e)) (newline) e))))
+(define-syntax double
+  (syntax-rules ()
+    ((_ x) (* 2 x))))
+(show (double 5))
+(define f (lambda (x) (show (double x))))
+(f 1)
+(f 2)
+
+; A define-syntax inside a body defines a macro for that body only.
+(define g
+  (lambda (n)
+    (begin
+      (define-syntax inc
+        (syntax-rules ()
+          ((_ v) (+ v 1))))
+      (inc n))))
+(g 41)
+(define inc (lambda (v) (- v 1)))
+(inc 41)
+
+; A local variable still hides a macro of the same name.
+(let ((double (lambda (x) x)))
+  (double 7))
+
+; Names a template binds don't capture the user's.
+(define-syntax my-or
+  (syntax-rules ()
+    ((_ a b) (let ((t a)) (if t t b)))))
+(define t 5)
+(my-or #f t)
+
+; A name a template binds is renamed only where the binding is visible, so
+; the template's other uses of it still mean the global.
+(define x 5)
+(define-syntax m
+  (syntax-rules ()
+    ((m) (+ (let ((x 1)) x) x))))
+(m)
+
+; Renamed binders can't capture a user's name, whatever it is.
+(define-syntax swap!
+  (syntax-rules ()
+    ((_ a b) (let ((tmp a)) (begin (set! a b) (set! b tmp))))))
+(define tmp.1 1)
+(define tmp 2)
+(swap! tmp tmp.1)
+tmp
+tmp.1
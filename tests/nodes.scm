@@ -0,0 +1,29 @@
+; A call that has specialized still prints as it was read when its form is
+; also quoted data.
+(define-syntax show
+  (syntax-rules ()
+    ((_ e) (begin (write (quote e)) (newline) e))))
+(define twice (lambda (x) (show (* x 2))))
+(twice 1)
+(twice 2)
+(twice 2.5)
+
+; A call keeps its answers as the types it sees change.
+(define add (lambda (a b) (+ a b)))
+(add 1 2)
+(add 1.5 2)
+(add 1.5 2.5)
+(add 3 4)
+(define less (lambda (a b) (< a b)))
+(less 1 2)
+(less 2.5 1)
+(less 1 2.5)
+
+; A call's operator may change from one run to the next.
+(define op +)
+(define run (lambda (a b) (op a b)))
+(run 6 3)
+(define op -)
+(run 6 3)
+(define op (lambda (a b) (list a b)))
+(run 6 3)
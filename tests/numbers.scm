@@ -0,0 +1,12 @@
+; Integer literals are read the way a cast of strtol's result reads them:
+; within a long they wrap to an int, and beyond one they saturate first.
+2147483647
+2147483648
+-2147483649
+9223372036854775807
+9223372036854775808
+99999999999999999999
+-9223372036854775808
+-99999999999999999999
+1.5
+0.000000000000000000001
@@ -1,251 +1,517 @@
 #include <stdio.h>
 #include <stdbool.h>
-#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "tokenizer.h"
 #include "talloc.h"
 #include "linkedlist.h"
+#include "output.h"
+#include "symbol.h"
 
-int isParens(char target) {
-    char parens[] = {'(', ')', '[', ']'};
-    int length = sizeof(parens);
-    for (int i = 0; i < length; i++) {
-        if (parens[i] == target) {
-            return 1;
-        }
+// Character classes, looked up with one load per character instead of
+// searching lists of characters.
+#define SPACE_CLASS 1
+#define PAREN_CLASS 2
+#define DIGIT_CLASS 4
+#define SYMBOL_START_CLASS 8
+#define DELIMITER_CLASS (SPACE_CLASS | PAREN_CLASS)
+
+const unsigned char charClass[256] = {
+    [' '] = SPACE_CLASS, ['\t'] = SPACE_CLASS, ['\n'] = SPACE_CLASS,
+    ['\v'] = SPACE_CLASS, ['\f'] = SPACE_CLASS, ['\r'] = SPACE_CLASS,
+    ['('] = PAREN_CLASS, [')'] = PAREN_CLASS,
+    ['['] = PAREN_CLASS, [']'] = PAREN_CLASS,
+    ['0' ... '9'] = DIGIT_CLASS,
+    ['a' ... 'z'] = SYMBOL_START_CLASS, ['A' ... 'Z'] = SYMBOL_START_CLASS,
+    ['!'] = SYMBOL_START_CLASS, ['$'] = SYMBOL_START_CLASS,
+    ['%'] = SYMBOL_START_CLASS, ['&'] = SYMBOL_START_CLASS,
+    ['*'] = SYMBOL_START_CLASS, ['/'] = SYMBOL_START_CLASS,
+    [':'] = SYMBOL_START_CLASS, ['<'] = SYMBOL_START_CLASS,
+    ['='] = SYMBOL_START_CLASS, ['>'] = SYMBOL_START_CLASS,
+    ['?'] = SYMBOL_START_CLASS, ['~'] = SYMBOL_START_CLASS,
+    ['_'] = SYMBOL_START_CLASS, ['^'] = SYMBOL_START_CLASS,
+};
+
+#define hasClass(c, class) (charClass[(unsigned char)(c)] & (class))
+
+// The current input, one per thread so that interpreters on different
+// threads read independently. Everything from tokenStart on is kept when the
+// buffer is refilled, so a token can span reads.
+_Thread_local InputSource input = {NULL, 0, 0, 0, 0, 0, 0, 1};
+
+#define INPUT_CHUNK 65536
+
+// Punctuation tokens carry no data, so a single shared value of each type is
+// handed out rather than allocating one per occurrence.
+Value openToken = {.type = OPEN_TYPE, .s = "("};
+Value closeToken = {.type = CLOSE_TYPE, .s = ")"};
+Value openBracketToken = {.type = OPENBRACKET_TYPE, .s = "["};
+Value closeBracketToken = {.type = CLOSEBRACKET_TYPE, .s = "]"};
+Value dotToken = {.type = DOT_TYPE, .s = "."};
+Value singleQuoteToken = {.type = SINGLEQUOTE_TYPE, .s = "'"};
+
+void tokenizationError(const char *message, char *token) {
+    outString("Syntax error ");
+    outString(message);
+    outString(": ");
+    outString(token);
+    outChar('\n');
+    outFlush();
+    abandonEvaluation();
+}
+
+// Releases the current input's buffer if the tokenizer allocated it.
+void releaseInput() {
+    if (input.fd >= 0) {
+        free(input.buffer);
     }
-    return 0;
+    input.buffer = NULL;
+    input.capacity = 0;
 }
 
-int isMiscSymbol(char target) {
-    char miscSymbols[] = {'!', '$', '%', '&', '*', '/', ':', '<',
-                            '=', '>', '?', '~', '_', '^'};
-    int length = sizeof(miscSymbols);
-    for (int i = 0; i < length; i++) {
-        if (miscSymbols[i] == target) {
-            return 1;
+// Make the tokenizer read from the given file descriptor.
+void setInputFd(int fd) {
+    releaseInput();
+    input.fd = fd;
+    input.length = 0;
+    input.pos = 0;
+    input.tokenStart = 0;
+    input.lineCounted = 0;
+    input.line = 1;
+}
+
+// Make the tokenizer read from a fixed block of memory.
+void setInputBuffer(const char *data, size_t length) {
+    releaseInput();
+    input.buffer = (char *)data;
+    input.capacity = length;
+    input.length = length;
+    input.pos = 0;
+    input.tokenStart = 0;
+    input.fd = -1;
+    input.lineCounted = 0;
+    input.line = 1;
+}
+
+// Returns the current input and detaches it from the tokenizer, which is left
+// at end of input until given a new one.
+InputSource saveInput() {
+    InputSource saved = input;
+    input.buffer = NULL;
+    input.capacity = 0;
+    input.length = 0;
+    input.pos = 0;
+    input.tokenStart = 0;
+    input.fd = -1;
+    input.lineCounted = 0;
+    input.line = 1;
+    return saved;
+}
+
+// Goes back to reading from an input returned by saveInput.
+void restoreInput(InputSource saved) {
+    releaseInput();
+    input = saved;
+}
+
+// Reads more input into the buffer, keeping the token being scanned. Returns
+// 0 at end of input.
+int refillInput() {
+    if (input.fd < 0) {
+        return 0;
+    }
+    if (input.tokenStart > 0) {
+        //lines before the token are about to be discarded, so count them
+        tokenLine();
+        input.lineCounted = 0;
+        memmove(input.buffer, input.buffer + input.tokenStart,
+                input.length - input.tokenStart);
+        input.length -= input.tokenStart;
+        input.pos -= input.tokenStart;
+        input.tokenStart = 0;
+    }
+    if (input.length == input.capacity) {
+        input.capacity = input.capacity ? input.capacity * 2 : INPUT_CHUNK;
+        input.buffer = realloc(input.buffer, input.capacity);
+        if (input.buffer == NULL) {
+            tokenizationError("out of memory while reading", "");
         }
     }
-    return 0;
+    //whatever has been printed so far should be seen before waiting for
+    //more input
+    outFlush();
+    ssize_t bytesRead;
+    do {
+        bytesRead = read(input.fd, input.buffer + input.length,
+                         input.capacity - input.length);
+    } while (bytesRead < 0 && errno == EINTR);
+    if (bytesRead <= 0) {
+        return 0;
+    }
+    input.length += bytesRead;
+    return 1;
 }
 
-void tokenizationError(const char *message, char *token) {
-    printf("Syntax error %s: %s\n", message, token);
-    texit(1);
+int tokenLine() {
+    const char *next = input.buffer + input.lineCounted;
+    const char *end = input.buffer + input.tokenStart;
+    while (next < end) {
+        next = memchr(next, '\n', end - next);
+        if (next == NULL) {
+            break;
+        }
+        input.line++;
+        next++;
+    }
+    input.lineCounted = input.tokenStart;
+    return input.line;
 }
 
-Value *addTokenToList(Value *head, valueType tokenType, char *token) {
-    /* token types:
-    boolean, integer, double, string, symbol, open, close*/
-    Value *newVal = talloc(sizeof(Value));
-    newVal->type = tokenType;
-    if (tokenType == STR_TYPE || tokenType == SYMBOL_TYPE) {
-        newVal->s = token;
-    } else if (tokenType == INT_TYPE || tokenType == BOOL_TYPE) {
-        newVal->i = (int) strtol(token, (char **)NULL, 10);
-    } else if (tokenType == DOUBLE_TYPE) {
-        newVal->d = (double) strtod(token, (char**)NULL);
-    } else {
-        newVal->s = token;
+// Returns the character at the current position without consuming it, or EOF.
+int peekChar() {
+    if (input.pos == input.length && !refillInput()) {
+        return EOF;
     }
-    Value *temp = head;
-    head = cons(newVal, temp);
-    return head;
+    return (unsigned char)input.buffer[input.pos];
 }
 
-Value *addStringToken(Value *head) {
-    char *string = talloc(301);
-    string[0] = '"';
-    char nextChar = (char)fgetc(stdin);
-    int i = 1;
-    while(nextChar != '"'){
-        string[i] = nextChar;
-        i++;
-        if (nextChar == EOF){
-            string[i] = '\0';
-            tokenizationError("reached end of file while tokenizing string", string);
-            break;
+#ifdef __SSE2__
+// Bitmask of the bytes in chunk that are whitespace.
+static inline unsigned spaceMask(__m128i chunk) {
+    __m128i blank = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '));
+    //'\t' through '\r' are consecutive
+    __m128i control = _mm_sub_epi8(chunk, _mm_set1_epi8('\t'));
+    control = _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8(4)), control);
+    return _mm_movemask_epi8(_mm_or_si128(blank, control));
+}
+
+// Bitmask of the bytes in chunk that end a symbol or number.
+static inline unsigned delimiterMask(__m128i chunk) {
+    __m128i parens = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('(')),
+                     _mm_cmpeq_epi8(chunk, _mm_set1_epi8(')'))),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('[')),
+                     _mm_cmpeq_epi8(chunk, _mm_set1_epi8(']'))));
+    return spaceMask(chunk) | _mm_movemask_epi8(parens);
+}
+#endif
+
+// Returns the first position at or after pos that is not whitespace, or the
+// end of the buffered input.
+size_t skipSpaces(size_t pos) {
+    const char *buffer = input.buffer;
+    //tokens are usually separated by a single space, so check the first
+    //two characters before scanning in blocks
+    for (int i = 0; i < 2; i++) {
+        if (pos == input.length || !hasClass(buffer[pos], SPACE_CLASS)) {
+            return pos;
         }
-        nextChar = (char)fgetc(stdin);
+        pos++;
+    }
+#ifdef __SSE2__
+    while (pos + 16 <= input.length) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(buffer + pos));
+        unsigned mask = ~spaceMask(chunk) & 0xFFFF;
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+#endif
+    while (pos < input.length && hasClass(buffer[pos], SPACE_CLASS)) {
+        pos++;
     }
-    string[i] = '"';
-    string[i+1] = '\0';
-    head = addTokenToList(head, STR_TYPE, string);
-    return head;
+    return pos;
 }
 
-Value *addNumberToken(Value *head) {
-    char nextChar = (char)fgetc(stdin);
-    char *number = talloc(301);
-    int endOfNumber = 0;
-    int isDouble = 0;
-    int i = 0;
-    while (!endOfNumber) {
-        if (nextChar == '.') {
-            isDouble = 1;
+// Returns the first position at or after pos that holds a delimiter, or the
+// end of the buffered input.
+size_t findDelimiter(size_t pos) {
+    const char *buffer = input.buffer;
+#ifdef __SSE2__
+    while (pos + 16 <= input.length) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(buffer + pos));
+        unsigned mask = delimiterMask(chunk);
+        if (mask) {
+            return pos + __builtin_ctz(mask);
         }
-        number[i] = nextChar;
+        pos += 16;
+    }
+#endif
+    while (pos < input.length && !hasClass(buffer[pos], DELIMITER_CLASS)) {
+        pos++;
+    }
+    return pos;
+}
+
+// Consumes the rest of the current token up to the next delimiter or the end
+// of input, and returns its length. The token text starts at
+// input.buffer + input.tokenStart.
+size_t scanToDelimiter() {
+    input.pos = findDelimiter(input.pos);
+    while (input.pos == input.length && refillInput()) {
+        input.pos = findDelimiter(input.pos);
+    }
+    return input.pos - input.tokenStart;
+}
+
+// Copies the current token's text into a new string.
+char *copyToken(size_t length) {
+    char *text = talloc(length + 1);
+    memcpy(text, input.buffer + input.tokenStart, length);
+    text[length] = '\0';
+    return text;
+}
+
+// Exact powers of ten that a double can hold.
+const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// A NUL-terminated copy of text[0, length), for the strto* functions.
+char *terminatedCopy(const char *text, size_t length) {
+    char *copy = talloc(length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+// Parses the number in text[0, length), which holds only an optional sign,
+// digits and dots. An integer is what a cast of strtol's result gives: one
+// too long to be sure it fits in a long is handed to strtol, which saturates
+// at LONG_MIN and LONG_MAX. A double whose digits fit exactly in a double is
+// computed with one correctly rounded division; anything else falls back to
+// strtod.
+Value *parseNumber(const char *text, size_t length) {
+    Value *number = talloc(sizeof(Value));
+    size_t i = 0;
+    int negative = 0;
+    if (text[0] == '+' || text[0] == '-') {
+        negative = text[0] == '-';
         i++;
-        nextChar = (char)fgetc(stdin);
-        if (isParens(nextChar) || 
-        isspace(nextChar) || nextChar == EOF) {
-            ungetc(nextChar, stdin);
-            break;
-        } else if (!isdigit(nextChar) && nextChar != '.') {
-            number[i] = '\0';
-            tokenizationError("invalid character for double or int token", number);
-            break;
+    }
+    unsigned long long mantissa = 0;
+    int digits = 0;
+    while (i < length && text[i] != '.') {
+        mantissa = mantissa * 10 + (text[i] - '0');
+        digits++;
+        i++;
+    }
+    if (i == length) {
+        number->type = INT_TYPE;
+        if (digits < 19) {
+            number->i = (int)(negative ? -mantissa : mantissa);
+        } else {
+            number->i = (int)strtol(terminatedCopy(text, length), NULL, 10);
         }
+        return number;
+    }
+    number->type = DOUBLE_TYPE;
+    int fractionDigits = 0;
+    i++;
+    while (i < length && text[i] != '.') {
+        mantissa = mantissa * 10 + (text[i] - '0');
+        digits++;
+        fractionDigits++;
+        i++;
     }
-    number[i] = '\0';
-    valueType tokenType;
-    if (isDouble) {
-        tokenType = DOUBLE_TYPE;
+    if (i == length && digits <= 15) {
+        double value = (double)mantissa / powersOfTen[fractionDigits];
+        number->d = negative ? -value : value;
     } else {
-        tokenType = INT_TYPE;
+        number->d = strtod(terminatedCopy(text, length), NULL);
     }
-    head = addTokenToList(head, tokenType, number);
-    return head;
+    return number;
 }
 
-Value *addSymbolToken(Value *head) {
-    char nextChar = (char)fgetc(stdin);
-    char *symbol = talloc(301);
-    int endOfSymbol = 0;
-    int i = 0;
-    while (endOfSymbol != 1) {
-        symbol[i] = nextChar;
-        i++;
-        nextChar = (char)fgetc(stdin);
-        if (isParens(nextChar) || 
-        isspace(nextChar) || nextChar == EOF) {
+Value *readStringToken() {
+    //the token keeps its surrounding quotes
+    size_t searchFrom = input.pos + 1;
+    char *close = NULL;
+    while (1) {
+        close = memchr(input.buffer + searchFrom, '"',
+                       input.length - searchFrom);
+        if (close != NULL) {
             break;
         }
+        searchFrom = input.length - input.tokenStart;
+        if (!refillInput()) {
+            input.pos = input.length;
+            tokenizationError("reached end of file while tokenizing string",
+                              copyToken(input.length - input.tokenStart));
+        }
+        searchFrom += input.tokenStart;
+    }
+    input.pos = close - input.buffer + 1;
+    Value *token = talloc(sizeof(Value));
+    token->type = STR_TYPE;
+    token->s = copyToken(input.pos - input.tokenStart);
+    return token;
+}
+
+Value *readNumberToken() {
+    input.pos++;
+    size_t length = scanToDelimiter();
+    const char *text = input.buffer + input.tokenStart;
+    for (size_t i = 1; i < length; i++) {
+        if (!hasClass(text[i], DIGIT_CLASS) && text[i] != '.') {
+            tokenizationError("invalid character for double or int token",
+                              copyToken(i + 1));
+        }
     }
-    symbol[i] = '\0';
-    ungetc(nextChar, stdin);
-    head = addTokenToList(head, SYMBOL_TYPE, symbol);
-    return head;
+    return parseNumber(text, length);
 }
 
-Value *addBoolToken(Value *head) {
-    char nextChar = (char)fgetc(stdin);
-    char *intBool = talloc(2);
+Value *readSymbolToken() {
+    input.pos++;
+    size_t length = scanToDelimiter();
+    Value *token = talloc(sizeof(Value));
+    token->type = SYMBOL_TYPE;
+    token->s = internSymbol(input.buffer + input.tokenStart, length);
+    return token;
+}
+
+Value *readBoolToken() {
+    input.pos++;
+    int nextChar = peekChar();
+    Value *token = talloc(sizeof(Value));
+    token->type = BOOL_TYPE;
     if (nextChar == 't' || nextChar == 'T') {
-        intBool[0] = '1';
+        token->i = 1;
     } else if (nextChar == 'f' || nextChar == 'F') {
-        intBool[0] = '0';
+        token->i = 0;
     } else {
         char *badChar = talloc(2);
         badChar[0] = nextChar;
         badChar[1] = '\0';
         tokenizationError("invalid character for boolean token", badChar);
     }
-    intBool[1] = '\0';
-    nextChar = (char)fgetc(stdin);
-    ungetc(nextChar, stdin);
-    if (!isspace(nextChar) && nextChar != ')') {
+    input.pos++;
+    nextChar = peekChar();
+    if (nextChar != EOF && !hasClass(nextChar, DELIMITER_CLASS)) {
         char *badChar = talloc(2);
         badChar[0] = nextChar;
         badChar[1] = '\0';
         tokenizationError("non-whitespace character detected after boolean token", badChar);
     }
-    head = addTokenToList(head, BOOL_TYPE, intBool);
-    return head;
+    return token;
 }
 
+// Skips from a ';' to the end of its line. Returns 1 if the input ends first.
 int skipComment() {
-    char nextChar = (char)fgetc(stdin);
-    while (nextChar != '\n' && nextChar != EOF) {
-        nextChar = (char)fgetc(stdin);
-    }
-    if (nextChar == EOF) {
-        return 1;
-    } else {
-        return 0;
+    while (1) {
+        char *newline = memchr(input.buffer + input.pos, '\n',
+                               input.length - input.pos);
+        if (newline != NULL) {
+            input.pos = newline - input.buffer + 1;
+            return 0;
+        }
+        input.pos = input.length;
+        input.tokenStart = input.pos;
+        if (!refillInput()) {
+            return 1;
+        }
     }
 }
 
-// Read all of the input from stdin, and return a linked list consisting of the
-// tokens.
-Value *tokenize() {
-    char charRead;
-    Value *list = makeNull();
-    charRead = (char)fgetc(stdin);
-    while (charRead != EOF) {
-        if (charRead == '"') {
-            list = addStringToken(list);
-        } else if (charRead == ';') {
-            if (skipComment()) {
-                break;
-            }
-        } else if (charRead == '(') {
-            char *character = talloc(2);
-            character[0] = charRead;
-            list = addTokenToList(list, OPEN_TYPE, character);
+// Reads the token that starts at the current position, whose first character
+// is charRead, and returns it.
+Value *readToken(char charRead) {
+    Value *token = NULL;
+    if (charRead == '"') {
+        token = readStringToken();
+    } else if (hasClass(charRead, PAREN_CLASS)) {
+        input.pos++;
+        if (charRead == '(') {
+            token = &openToken;
         } else if (charRead == ')') {
-            char *character = talloc(2);
-            character[0] = charRead;
-            list = addTokenToList(list, CLOSE_TYPE, character);
+            token = &closeToken;
         } else if (charRead == '[') {
-            char *character = talloc(2);
-            character[0] = charRead;
-            list = addTokenToList(list, OPENBRACKET_TYPE, character);
-        } else if (charRead == ']') {
-            char *character = talloc(2);
-            character[0] = charRead;
-            list = addTokenToList(list, CLOSEBRACKET_TYPE, character);
-        } else if (charRead == '+' || charRead == '-') {
-            char nextChar = (char)fgetc(stdin);
-            ungetc(nextChar, stdin);
-            ungetc(charRead, stdin);
-            if (isspace(nextChar) || nextChar == ')') {
-                list = addSymbolToken(list);
-            } else {
-                list = addNumberToken(list);
-            }
-        } else if (isalpha(charRead) || isMiscSymbol(charRead)) {
-            ungetc(charRead, stdin);
-            list = addSymbolToken(list); 
-        } else if (isdigit(charRead) || charRead == '.') {
-            char nextChar = (char)fgetc(stdin);
-            ungetc(nextChar, stdin);
-            if (isspace(nextChar) && charRead == '.') {
-                char *character = talloc(2);
-                character[0] = charRead;
-                list = addTokenToList(list, DOT_TYPE, character);
-            } else {
-                ungetc(charRead, stdin);
-                list = addNumberToken(list);
+            token = &openBracketToken;
+        } else {
+            token = &closeBracketToken;
+        }
+    } else if (charRead == '+' || charRead == '-') {
+        input.pos++;
+        int nextChar = peekChar();
+        input.pos--;
+        if (nextChar == EOF || hasClass(nextChar, DELIMITER_CLASS)) {
+            token = readSymbolToken();
+        } else {
+            token = readNumberToken();
+        }
+    } else if (hasClass(charRead, SYMBOL_START_CLASS)) {
+        token = readSymbolToken(); 
+    } else if (hasClass(charRead, DIGIT_CLASS) || charRead == '.') {
+        input.pos++;
+        int nextChar = peekChar();
+        if (charRead == '.' && nextChar != EOF &&
+            hasClass(nextChar, SPACE_CLASS)) {
+            token = &dotToken;
+        } else if (charRead == '.' && nextChar == '.') {
+            //the ellipsis of syntax-rules is a symbol, not a number
+            input.pos--;
+            token = readSymbolToken();
+        } else {
+            input.pos--;
+            token = readNumberToken();
+        }
+    } else if (charRead == '\'') {
+        input.pos++;
+        int nextChar = peekChar();
+        if (nextChar != EOF && hasClass(nextChar, SPACE_CLASS)) {
+            tokenizationError("whitespace after single quote", "\' ");
+        }
+        token = &singleQuoteToken;
+    } else if (charRead == '#') {
+        token = readBoolToken();
+    } else {
+        char *character = talloc(2);
+        character[0] = charRead;
+        character[1] = '\0';
+        tokenizationError("character does not match starting characters for any token type", character);
+    }
+    return token;
+}
+
+// Read the next token from the input and return it, or NULL at end of input.
+Value *nextToken() {
+    while (1) {
+        input.pos = skipSpaces(input.pos);
+        input.tokenStart = input.pos;
+        if (input.pos == input.length) {
+            if (!refillInput()) {
+                return NULL;
             }
-        } else if (charRead == '\'') {
-            char nextChar = (char)fgetc(stdin);
-            ungetc(nextChar, stdin);
-            if (isspace(nextChar)) {
-                tokenizationError("whitespace after single quote", "\' ");
+        } else if (input.buffer[input.pos] == ';') {
+            if (skipComment()) {
+                return NULL;
             }
-            char *character = talloc(2);
-            character[0] = charRead;
-            character[1] = '\0';
-            list = addTokenToList(list, SINGLEQUOTE_TYPE, character);
-        } else if (charRead == '#') {
-            list = addBoolToken(list);
-        } else if (isspace(charRead)) {
-           // do nothing
         } else {
-            char *character = talloc(2);
-            character[0] = charRead;
-            character[1] = '\0';
-            tokenizationError("character does not match starting characters for any token type", character);
+            return readToken(input.buffer[input.pos]);
         }
-        charRead = (char)fgetc(stdin);   
+    }
+}
+
+// Read all of the input from stdin, and return a linked list consisting of the
+// tokens.
+Value *tokenize() {
+    Value *list = makeNull();
+    Value *token = nextToken();
+    while (token != NULL) {
+        list = cons(token, list);
+        token = nextToken();
     }
     Value *revList = reverse(list);
     return revList;
 }
 
-//use gets(*char) to get a line from stdin--we can preset a string to length 301 and be safe
-
 // Displays the contents of the linked list as tokens, with type information
 void displayTokens(Value *list) {
     while (!isNull(list)) {
@@ -253,40 +519,44 @@ void displayTokens(Value *list) {
         switch(tokenValue->type) {
             case BOOL_TYPE:
                 if (tokenValue->i == 0) {
-                    printf("#f:boolean\n"); 
+                    outString("#f:boolean\n"); 
                 } else {
-                    printf("#t:boolean\n");
+                    outString("#t:boolean\n");
                 }
                 break;
             case INT_TYPE:
-                printf("%d:integer\n", tokenValue->i);
+                outInt(tokenValue->i);
+                outString(":integer\n");
                 break;
             case DOUBLE_TYPE:
-                printf("%f:double\n", tokenValue->d);
+                outDouble(tokenValue->d);
+                outString(":double\n");
                 break;
             case STR_TYPE:
-                printf("%s:string\n", tokenValue->s);
+                outString(tokenValue->s);
+                outString(":string\n");
                 break;
             case SYMBOL_TYPE:
-                printf("%s:symbol\n", tokenValue->s);
+                outString(tokenValue->s);
+                outString(":symbol\n");
                 break;
             case OPEN_TYPE:
-                printf("(:open\n");
+                outString("(:open\n");
                 break;
             case CLOSE_TYPE:
-                printf("):close\n");
+                outString("):close\n");
                 break;
             case OPENBRACKET_TYPE:
-                printf("[:openbracket\n");
+                outString("[:openbracket\n");
                 break;
             case CLOSEBRACKET_TYPE:
-                printf("]:closebracket\n");
+                outString("]:closebracket\n");
                 break;
             case DOT_TYPE:
-                printf(".:dot\n");
+                outString(".:dot\n");
                 break;
             case SINGLEQUOTE_TYPE:
-                printf("':singlequote\n");
+                outString("':singlequote\n");
                 break;
             case CONS_TYPE:
                 break;  
@@ -300,6 +570,12 @@ void displayTokens(Value *list) {
                 break;
             case PRIMITIVE_TYPE:
                 break;
+            case FUTURE_TYPE:
+                break;
+            case CHANNEL_TYPE:
+                break;
+            case PROMISE_TYPE:
+                break;
         }
         Value *temp = list;
         list = cdr(temp);
@@ -1,3 +1,4 @@
+#include <stddef.h>
 #include "value.h"
 
 #ifndef _TOKENIZER
@@ -7,6 +8,43 @@
 // tokens.
 Value *tokenize();
 
+// Where the tokenizer reads characters from: a file descriptor that is read
+// into a growable buffer, or a fixed block of memory when fd is -1. Lines
+// are only counted when asked for, up to lineCounted.
+typedef struct InputSource {
+    char *buffer;
+    size_t capacity;
+    size_t length;
+    size_t pos;
+    size_t tokenStart;
+    int fd;
+    size_t lineCounted;
+    int line;
+} InputSource;
+
+// Make the tokenizer read from the given file descriptor. Reading starts
+// from stdin.
+void setInputFd(int fd);
+
+// Make the tokenizer read from a fixed block of memory, which must stay valid
+// while it is being read.
+void setInputBuffer(const char *data, size_t length);
+
+// Returns the current input and detaches it from the tokenizer, so that
+// something else can be read and the input put back with restoreInput.
+InputSource saveInput();
+
+// Goes back to reading from an input returned by saveInput.
+void restoreInput(InputSource saved);
+
+// Read the next token from the input and return it, or NULL at end of input.
+// Punctuation tokens are shared values and must not be modified.
+Value *nextToken();
+
+// Returns the line, counting from 1, that the token last returned by
+// nextToken starts on.
+int tokenLine();
+
 // Displays the contents of the linked list as tokens, with type information
 void displayTokens(Value *list);
 
@@ -1,6 +1,13 @@
 #ifndef _VALUE
 #define _VALUE
 
+// Where a promise is in being forced. A chained promise comes from
+// delay-force and has a promise as its value; a forwarded one has handed
+// its state to the promise it points to.
+typedef enum {
+    PROMISE_PENDING, PROMISE_CHAINED, PROMISE_FORCED, PROMISE_FORWARDED
+} promiseState;
+
 typedef enum {
     INT_TYPE, DOUBLE_TYPE, STR_TYPE, CONS_TYPE, NULL_TYPE, PTR_TYPE,
     OPEN_TYPE, CLOSE_TYPE, BOOL_TYPE, SYMBOL_TYPE,
@@ -14,6 +21,15 @@ typedef enum {
     // Type below is new for primitive portion
     PRIMITIVE_TYPE,
 
+    // A future from the future or pmap primitives; p points to its task
+    FUTURE_TYPE,
+
+    // A channel from make-channel; p points to its queue
+    CHANNEL_TYPE,
+
+    // A promise from delay, delay-force, cons-stream or make-promise
+    PROMISE_TYPE,
+
 } valueType;
 
 struct Value {
@@ -38,6 +54,14 @@ struct Value {
             struct Frame *frame;
         } closure;
         
+        // A promise: while pending its content is a closure of no arguments
+        // to run, once forced it is the value, and when forwarded it is the
+        // promise that took over.
+        struct Promise {
+            promiseState state;
+            struct Value *content;
+        } promise;
+
         // A primitive style function; just a pointer to it, with the right
         // signature (primFn = primitive function)
         struct Value *(*primFn)(struct Value *);
@@ -49,10 +73,12 @@ typedef struct Value Value;
 
 // A frame is a linked list of bindings, and a pointer to another frame.  A
 // binding is a variable name (represented as a string), and a pointer to the
-// Value it is bound to.
+// Value it is bound to. code is what runs in the frame, which a define in
+// it could add to the bindings, or NULL if that isn't known.
 struct Frame {
     struct Value *bindings;
     struct Frame *parent;
+    struct Value *code;
 };
 
 typedef struct Frame Frame;